@@ -0,0 +1,411 @@
+#include "bench.h"
+#include "config.h"
+#include "gset.h"
+#include "wire.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *ARRIVAL_NAMES[] = { "closed", "poisson", "bursty" };
+
+const char *wl_arrival_name(Arrival a) { return ARRIVAL_NAMES[a]; }
+
+void wl_defaults(Workload *w) {
+    memset(w, 0, sizeof(*w));
+    w->arrival = ARR_CLOSED;
+    w->think = 1.0;
+    w->burst = 4;
+    w->cs = 2.0;
+    w->duration = 5.0;
+    w->seed = 1;
+    w->resources = 1;
+    w->hold = 1;
+}
+
+void wl_free(Workload *w) {
+    free(w->mix_off);
+    free(w->mix_groups);
+    free(w->mix_cum);
+    w->nmix = 0;
+    w->mix_off = w->mix_groups = NULL;
+    w->mix_cum = NULL;
+}
+
+static int parse_u64(const char *s, uint64_t *out) {
+    char *end;
+    if (*s < '0' || *s > '9') return -1;
+    errno = 0;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (*end || errno == ERANGE) return -1;
+    *out = v;
+    return 0;
+}
+
+static int parse_double(const char *s, double *out) {
+    char *end;
+    double v = strtod(s, &end);
+    if (end == s || *end || v < 0) return -1;
+    *out = v;
+    return 0;
+}
+
+/* "0:5,1:3,0+1:2" = {g0} weight 5, {g1} weight 3, {g0,g1} weight 2 */
+static int parse_mix(Workload *w, const char *s) {
+    wl_free(w);
+    int sets = 1, groups = 1;
+    for (const char *p = s; *p; ++p) { if (*p == ',') ++sets, ++groups; if (*p == '+') ++groups; }
+    w->mix_off = calloc(sets + 1, sizeof(int));
+    w->mix_groups = malloc(groups * sizeof(int));
+    w->mix_cum = malloc(sets * sizeof(double));
+    if (!w->mix_off || !w->mix_groups || !w->mix_cum) { wl_free(w); return -1; }
+
+    const char *p = s;
+    int k = 0, ng = 0;
+    double total = 0;
+    while (*p) {
+        do {
+            char *end;
+            long g = strtol(p, &end, 10);
+            if (end == p || g < 0) { wl_free(w); return -1; }
+            w->mix_groups[ng++] = (int)g;
+            p = end;
+        } while (*p == '+' && *++p);
+        double wt = 1.0;
+        if (*p == ':') {
+            char *end;
+            wt = strtod(++p, &end);
+            if (end == p || wt <= 0) { wl_free(w); return -1; }
+            p = end;
+        }
+        total += wt;
+        w->mix_cum[k] = total;
+        w->mix_off[++k] = ng;
+        if (*p == ',') ++p;
+        else if (*p) { wl_free(w); return -1; }
+    }
+    w->nmix = k;
+    return 0;
+}
+
+int wl_parse_arg(Workload *w, const char *a) {
+    if (strncmp(a, "--arrival=", 10) == 0) {
+        for (int k = 0; k < 3; ++k)
+            if (strcmp(a + 10, ARRIVAL_NAMES[k]) == 0) { w->arrival = (Arrival)k; return 1; }
+        return -1;
+    }
+    if (strncmp(a, "--think=", 8) == 0) return parse_double(a + 8, &w->think) ? -1 : 1;
+    if (strncmp(a, "--cs=", 5) == 0) return parse_double(a + 5, &w->cs) ? -1 : 1;
+    if (strcmp(a, "--cs-exp") == 0) { w->cs_exp = 1; return 1; }
+    if (strncmp(a, "--duration=", 11) == 0) return parse_double(a + 11, &w->duration) ? -1 : 1;
+    if (strncmp(a, "--entries=", 10) == 0) return cfg_parse_int(a + 10, 0, &w->entries) ? -1 : 1;
+    if (strncmp(a, "--burst=", 8) == 0) return cfg_parse_int(a + 8, 1, &w->burst) ? -1 : 1;
+    if (strncmp(a, "--seed=", 7) == 0) return parse_u64(a + 7, &w->seed) ? -1 : 1;
+    if (strncmp(a, "--mix=", 6) == 0) return parse_mix(w, a + 6) ? -1 : 1;
+    if (strncmp(a, "--resources=", 12) == 0) return cfg_parse_int(a + 12, 1, &w->resources) ? -1 : 1;
+    if (strncmp(a, "--hold=", 7) == 0) return cfg_parse_int(a + 7, 1, &w->hold) ? -1 : 1;
+    if (strncmp(a, "--replay=", 9) == 0) {
+        if (!a[9] || strlen(a + 9) >= sizeof(w->replay)) return -1;
+        strcpy(w->replay, a + 9);
+        return 1;
+    }
+    return 0;
+}
+
+int wl_check(const Workload *w, int ngroups) {
+    for (int i = 0; w->nmix && i < w->mix_off[w->nmix]; ++i)
+        if (w->mix_groups[i] >= ngroups) return -1;
+    return 0;
+}
+
+/* xorshift64* */
+static uint64_t rng_next(uint64_t *s) {
+    uint64_t x = *s;
+    x ^= x >> 12; x ^= x << 25; x ^= x >> 27;
+    *s = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+static double rng_uniform(uint64_t *s) { return (rng_next(s) >> 11) * (1.0 / 9007199254740992.0); }
+static double rng_exp(uint64_t *s, double mean) { return -mean * log(1.0 - rng_uniform(s)); }
+
+void wl_start(const Workload *w, WlState *s, int rank, double now) {
+    /* splitmix the seed so neighbouring ranks get unrelated streams */
+    uint64_t z = w->seed + 0x9E3779B97F4A7C15ULL * (uint64_t)(rank + 1);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    s->rng = (z ^ (z >> 31)) | 1;
+    s->next_arr = now;
+    s->left_in_burst = w->burst;
+}
+
+double wl_next_arrival(const Workload *w, WlState *s, double last_exit) {
+    double t = s->next_arr;
+    switch (w->arrival) {
+        case ARR_CLOSED:
+            return last_exit + w->think;
+        case ARR_POISSON:
+            s->next_arr += rng_exp(&s->rng, w->think);
+            break;
+        case ARR_BURSTY:
+            if (--s->left_in_burst <= 0) {
+                s->next_arr += rng_exp(&s->rng, w->think * w->burst);
+                s->left_in_burst = w->burst;
+            }
+            break;
+    }
+    return t;
+}
+
+double wl_cs_time(const Workload *w, WlState *s) {
+    return w->cs_exp ? rng_exp(&s->rng, w->cs) : w->cs;
+}
+
+int wl_pick_gset(const Workload *w, WlState *s, uint64_t *gs, int gw) {
+    if (w->nmix == 0) return 0;
+    double u = rng_uniform(&s->rng) * w->mix_cum[w->nmix - 1];
+    int k = 0;
+    while (k < w->nmix - 1 && u >= w->mix_cum[k]) ++k;
+    gs_zero(gs, gw);
+    for (int i = w->mix_off[k]; i < w->mix_off[k + 1]; ++i) gs_set(gs, w->mix_groups[i]);
+    return 1;
+}
+
+void wl_pick_res(const Workload *w, WlState *s, int *res) {
+    /* rejection plus insertion sort: hold is small and <= resources */
+    for (int n = 0; n < w->hold; ) {
+        int x = (int)(rng_next(&s->rng) % (uint64_t)w->resources), i = n;
+        int dup = 0;
+        for (int k = 0; k < n; ++k) dup |= res[k] == x;
+        if (dup) continue;
+        while (i > 0 && res[i - 1] > x) { res[i] = res[i - 1]; --i; }
+        res[i] = x;
+        ++n;
+    }
+}
+
+/**************************************************************************
+ * replay
+ **************************************************************************/
+/* records read ahead for one requester, in order */
+typedef struct {
+    RpRecord *rec;
+    uint64_t *gs;           /* set of rec[i] at gs + i * gw */
+    int head, n, cap;
+} RpQueue;
+
+struct Replay {
+    FILE *f;
+    int first, n;
+    int ngroups, fw, gw;    /* set words in the file / in the run */
+    unsigned char *buf;     /* one record as read */
+    size_t len;
+    RpQueue *q;
+};
+
+Replay *rp_open(const char *path, int first, int n, int ngroups, char *err, size_t errlen) {
+    FILE *f = fopen(path, "rb");
+    if (!f) { snprintf(err, errlen, "cannot open replay %s", path); return NULL; }
+    RpHeader h;
+    if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, RP_MAGIC, 4) || h.version != RP_VERSION) {
+        snprintf(err, errlen, "%s: not a replay file (or a different version)", path);
+        fclose(f);
+        return NULL;
+    }
+    if ((int)h.ngroups > ngroups) {
+        snprintf(err, errlen, "%s: sets over %u groups, need --groups=%u", path, h.ngroups, h.ngroups);
+        fclose(f);
+        return NULL;
+    }
+    /* records are small; read the file in large blocks */
+    setvbuf(f, NULL, _IOFBF, 1 << 20);
+
+    Replay *r = xrealloc(NULL, sizeof(Replay));
+    r->f = f;
+    r->first = first; r->n = n;
+    r->ngroups = ngroups;
+    r->fw = GSET_WORDS(h.ngroups);
+    r->gw = GSET_WORDS(ngroups);
+    r->len = sizeof(RpRecord) + (size_t)r->fw * sizeof(uint64_t);
+    r->buf = xrealloc(NULL, r->len);
+    r->q = xrealloc(NULL, (n ? n : 1) * sizeof(RpQueue));
+    memset(r->q, 0, (n ? n : 1) * sizeof(RpQueue));
+    return r;
+}
+
+/* read one record into its requester's queue; 0 at the end of the file */
+static int rp_read(Replay *r) {
+    if (fread(r->buf, r->len, 1, r->f) != 1) return 0;
+    RpRecord rec;
+    memcpy(&rec, r->buf, sizeof(rec));
+    int i = rec.req - r->first;
+    if (i < 0 || i >= r->n) return 1;
+
+    RpQueue *q = &r->q[i];
+    if (q->head && q->n == q->cap) {
+        /* reuse what has been played before growing */
+        q->n -= q->head;
+        memmove(q->rec, q->rec + q->head, q->n * sizeof(RpRecord));
+        memmove(q->gs, q->gs + (size_t)q->head * r->gw, (size_t)q->n * r->gw * sizeof(uint64_t));
+        q->head = 0;
+    }
+    if (q->n == q->cap) {
+        q->cap = q->cap ? 2 * q->cap : 4;
+        q->rec = xrealloc(q->rec, q->cap * sizeof(RpRecord));
+        q->gs = xrealloc(q->gs, (size_t)q->cap * r->gw * sizeof(uint64_t));
+    }
+    q->rec[q->n] = rec;
+    uint64_t *gs = q->gs + (size_t)q->n * r->gw;
+    gs_zero(gs, r->gw);
+    memcpy(gs, r->buf + sizeof(RpRecord), (size_t)r->fw * sizeof(uint64_t));
+    if (r->ngroups & 63) gs[r->gw - 1] &= ((uint64_t)1 << (r->ngroups & 63)) - 1;
+    ++q->n;
+    return 1;
+}
+
+int rp_next(Replay *r, int i, double *t, double *cs, int *res, uint64_t *gs) {
+    if (i < 0 || i >= r->n) return 0;
+    RpQueue *q = &r->q[i];
+    while (q->head == q->n)
+        if (!rp_read(r)) return 0;
+    const RpRecord *rec = &q->rec[q->head];
+    *t = rec->t;
+    *cs = rec->cs;
+    *res = rec->res;
+    gs_copy(gs, q->gs + (size_t)q->head * r->gw, r->gw);
+    ++q->head;
+    return 1;
+}
+
+void rp_close(Replay *r) {
+    if (!r) return;
+    fclose(r->f);
+    for (int i = 0; i < r->n; ++i) { free(r->q[i].rec); free(r->q[i].gs); }
+    free(r->q);
+    free(r->buf);
+    free(r);
+}
+
+void st_init(Stats *s) { memset(s, 0, sizeof(*s)); }
+void st_free(Stats *s) { free(s->rec); memset(s, 0, sizeof(*s)); }
+
+void st_cs(Stats *s, int rank, int res, int group, double arr, double enter, double exit) {
+    if (s->n == s->cap) {
+        int cap = s->cap ? 2 * s->cap : 256;
+        CsRec *r = realloc(s->rec, cap * sizeof(CsRec));
+        if (!r) return;
+        s->rec = r; s->cap = cap;
+    }
+    CsRec *r = &s->rec[s->n++];
+    r->t_arr = arr; r->t_enter = enter; r->t_exit = exit;
+    r->group = group; r->rank = rank; r->res = res;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+/* by resource, then entry time */
+static int cmp_enter(const void *a, const void *b) {
+    const CsRec *x = a, *y = b;
+    if (x->res != y->res) return (x->res > y->res) - (x->res < y->res);
+    return cmp_double(&x->t_enter, &y->t_enter);
+}
+
+/* sorts v; writes {"n":..,"mean":..,"p50":..,...} in microseconds */
+static void put_dist(FILE *f, const char *name, double *v, int n) {
+    fprintf(f, "  \"%s\": {\"n\": %d", name, n);
+    if (n > 0) {
+        qsort(v, n, sizeof(double), cmp_double);
+        double sum = 0;
+        for (int i = 0; i < n; ++i) sum += v[i];
+        const double ps[] = { 50, 90, 99, 99.9 };
+        const char *pn[] = { "p50", "p90", "p99", "p999" };
+        fprintf(f, ", \"mean\": %.3f", 1e6 * sum / n);
+        for (int k = 0; k < 4; ++k) {
+            int i = (int)(ps[k] / 100.0 * n);
+            if (i >= n) i = n - 1;
+            fprintf(f, ", \"%s\": %.3f", pn[k], 1e6 * v[i]);
+        }
+        fprintf(f, ", \"max\": %.3f", 1e6 * v[n - 1]);
+    }
+    fprintf(f, "}");
+}
+
+void bench_write(CsRec *all, int n, long sent, long local, const Workload *w, const char *meta,
+                 const char *out_path) {
+    qsort(all, n, sizeof(CsRec), cmp_enter);
+
+    double *lat = malloc((n ? n : 1) * sizeof(double));
+    double *sync = malloc((n ? n : 1) * sizeof(double));
+    char *overlap = calloc(n ? n : 1, 1);
+    int *active = malloc((n ? n : 1) * sizeof(int));
+    int nsync = 0, nact = 0, violations = 0;
+    double last_exit = -1e300;
+    double first = 1e300, last = -1e300;    /* span of the run */
+
+    /* sweep each resource's entries by entry time, keeping the ones
+       still inside its CS */
+    for (int i = 0; i < n; ++i) {
+        const CsRec *r = &all[i];
+        lat[i] = r->t_enter - r->t_arr;
+        if (r->t_arr < first) first = r->t_arr;
+        if (r->t_exit > last) last = r->t_exit;
+        if (i == 0 || r->res != all[i - 1].res) { nact = 0; last_exit = -1e300; }
+
+        int k = 0;
+        for (int j = 0; j < nact; ++j)
+            if (all[active[j]].t_exit > r->t_enter) active[k++] = active[j];
+        nact = k;
+
+        if (nact == 0) {
+            /* session boundary: it was already waiting when the CS emptied */
+            if (r->t_arr < last_exit) sync[nsync++] = r->t_enter - last_exit;
+        } else {
+            overlap[i] = 1;
+            for (int j = 0; j < nact; ++j) {
+                overlap[active[j]] = 1;
+                if (all[active[j]].group != r->group) ++violations;
+            }
+        }
+        active[nact++] = i;
+        if (r->t_exit > last_exit) last_exit = r->t_exit;
+    }
+    int nover = 0;
+    for (int i = 0; i < n; ++i) nover += overlap[i];
+
+    FILE *f = out_path ? fopen(out_path, "w") : stdout;
+    if (!f) { perror(out_path); f = stdout; }
+
+    fprintf(f, "{\n  %s,\n", meta);
+    fprintf(f, "  \"workload\": {\"arrival\": \"%s\", \"think_s\": %g, \"burst\": %d, "
+               "\"cs_s\": %g, \"cs_dist\": \"%s\", \"duration_s\": %g, \"entries\": %d, \"seed\": %llu, "
+               "\"resources\": %d, \"hold\": %d, \"replay\": \"%s\", \"mix\": \"",
+            wl_arrival_name(w->arrival), w->think, w->burst, w->cs,
+            w->cs_exp ? "exp" : "fixed", w->duration, w->entries, (unsigned long long)w->seed,
+            w->resources, w->hold, w->replay);
+    for (int k = 0; k < w->nmix; ++k) {
+        for (int i = w->mix_off[k]; i < w->mix_off[k + 1]; ++i)
+            fprintf(f, "%s%d", i > w->mix_off[k] ? "+" : "", w->mix_groups[i]);
+        fprintf(f, ":%g%s", w->mix_cum[k] - (k ? w->mix_cum[k - 1] : 0), k + 1 < w->nmix ? "," : "");
+    }
+    fprintf(f, "\"},\n");
+    fprintf(f, "  \"cs_entries\": %d,\n", n);
+    double span = n ? last - first : 0, per = w->entries || w->replay[0] ? span : w->duration;
+    fprintf(f, "  \"span_s\": %.6f,\n", span);
+    fprintf(f, "  \"cs_per_sec\": %.3f,\n", per > 0 ? n / per : 0.0);
+    fprintf(f, "  \"messages\": %ld,\n", sent);
+    fprintf(f, "  \"messages_per_cs\": %.3f,\n", n ? (double)sent / n : 0.0);
+    fprintf(f, "  \"local_messages\": %ld,\n", local);
+    fprintf(f, "  \"concurrent_entry_fraction\": %.4f,\n", n ? (double)nover / n : 0.0);
+    fprintf(f, "  \"mutex_violations\": %d,\n", violations);
+    put_dist(f, "acquire_latency_us", lat, n);
+    fprintf(f, ",\n");
+    put_dist(f, "sync_delay_us", sync, nsync);
+    fprintf(f, "\n}\n");
+    if (f != stdout) fclose(f);
+    else fflush(f);
+
+    free(lat); free(sync); free(overlap); free(active);
+}
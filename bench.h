@@ -0,0 +1,136 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/**************************************************************************
+ * benchmark mode - workload generation and end-of-run report
+ *
+ * arrivals: closed   next request `think` seconds after the last exit
+ *           poisson  open loop, exponential gaps with mean `think`
+ *           bursty   open loop, `burst` simultaneous arrivals, exponential
+ *                    gaps of mean think*burst between bursts
+ * open-loop latency is measured from the scheduled arrival, so a backlog
+ * at the requester shows up in the numbers.
+ *
+ * a CS holds `hold` distinct resources out of `resources`, and the report
+ * checks exclusion per resource.
+ *
+ * `entries` > 0 is a fixed workload: every client makes exactly that
+ * many CS entries and the run ends when they are all done, instead of
+ * after `duration`; rates are then over the run's actual span.
+ *
+ * `replay` names a captured workload (see below) that takes the place
+ * of all of the above but `resources`/`hold`: the run ends once it has
+ * been played through.
+ **************************************************************************/
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum { ARR_CLOSED, ARR_POISSON, ARR_BURSTY } Arrival;
+
+typedef struct {
+    Arrival arrival;
+    double think;           /* seconds, see above */
+    int burst;
+    double cs;              /* CS hold time (mean if cs_exp), may be 0 */
+    int cs_exp;
+    double duration;        /* seconds requesters keep issuing */
+    int entries;            /* CSs per client, 0 = run for duration */
+    uint64_t seed;
+    /* weighted group sets for each request; nmix == 0 keeps the per-rank sets */
+    int nmix;
+    int *mix_off;           /* set k is mix_groups[mix_off[k] .. mix_off[k+1]) */
+    int *mix_groups;
+    double *mix_cum;        /* cumulative weights */
+    int resources;          /* independent locks, drawn uniformly per CS */
+    int hold;               /* distinct resources held by one CS */
+    char replay[256];       /* captured workload file, "" = generate */
+} Workload;
+
+void wl_defaults(Workload *w);
+int  wl_parse_arg(Workload *w, const char *arg);   /* 1 consumed, 0 not ours, -1 bad value */
+int  wl_check(const Workload *w, int ngroups);     /* 0 ok, -1 group out of range */
+void wl_free(Workload *w);
+const char *wl_arrival_name(Arrival a);
+
+/* per-requester generator state */
+typedef struct {
+    uint64_t rng;
+    double next_arr;        /* next scheduled arrival (open loop) */
+    int left_in_burst;
+} WlState;
+
+void   wl_start(const Workload *w, WlState *s, int rank, double now);
+double wl_next_arrival(const Workload *w, WlState *s, double last_exit);
+double wl_cs_time(const Workload *w, WlState *s);
+/* draw the group set of the next request; returns 0 if the mix is empty */
+int    wl_pick_gset(const Workload *w, WlState *s, uint64_t *gs, int gw);
+/* draw the w->hold resources of the next CS, ascending */
+void   wl_pick_res(const Workload *w, WlState *s, int *res);
+
+/**************************************************************************
+ * replay - a captured workload, streamed from a file
+ *
+ * a header, then one fixed-size record per request in arrival order, in
+ * the host's byte order:
+ *   RpHeader   "GMEW", version, ngroups (sets in the file are
+ *              GSET_WORDS(ngroups) words)
+ *   RpRecord   logical requester (0-based over the job's requesters: the
+ *              i in cfg_home_set), arrival in seconds from the start of
+ *              the run, CS hold time, first resource (-1 draws them as
+ *              --resources/--hold do; else it holds res .. res+hold-1),
+ *              then the group set
+ * a reader goes through the file once, front to back, keeping only the
+ * records of its own requesters, and reads no further ahead than the
+ * next request one of them needs; memory does not grow with the file.
+ * gme_wl converts a text listing to this format and back.
+ **************************************************************************/
+#define RP_MAGIC   "GMEW"
+#define RP_VERSION 1
+
+typedef struct {
+    char magic[4];
+    uint32_t version, ngroups, reserved;
+} RpHeader;
+
+typedef struct {
+    int32_t req, res;
+    double t, cs;
+} RpRecord;                 /* followed by the group set */
+
+_Static_assert(sizeof(RpHeader) == 16 && sizeof(RpRecord) == 24, "replay records are packed");
+
+typedef struct Replay Replay;
+
+/* the records of requesters first .. first+n-1, whose sets must fit in
+   ngroups; NULL with a message in err if the file cannot be used */
+Replay *rp_open(const char *path, int first, int n, int ngroups, char *err, size_t errlen);
+/* requester first+i's next request: 1, or 0 once it has none left */
+int  rp_next(Replay *r, int i, double *t, double *cs, int *res, uint64_t *gs);
+void rp_close(Replay *r);
+
+/* per-rank measurements */
+typedef struct {
+    double t_arr, t_enter, t_exit;
+    int32_t group;
+    int32_t rank;
+    int32_t res;
+} CsRec;
+
+typedef struct {
+    CsRec *rec; int n, cap;
+    long sent;              /* protocol messages sent by this rank */
+    long local;             /* ... and delivered to itself in memory */
+    double clock_off;       /* add to the rank's clock to get rank 0's */
+} Stats;
+
+void st_init(Stats *s);
+void st_free(Stats *s);
+void st_cs(Stats *s, int rank, int res, int group, double arr, double enter, double exit);
+
+/* write the JSON report on the records of the whole run (sorted in
+   place), on one clock. meta is a preformatted list of "key": value
+   pairs for the header; out_path NULL is stdout */
+void bench_write(CsRec *all, int n, long sent, long local, const Workload *w, const char *meta,
+                 const char *out_path);
+
+#endif
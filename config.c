@@ -0,0 +1,253 @@
+#include "config.h"
+#include "gset.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CONFIG_DEPTH 8      /* nested --config files */
+
+void cfg_defaults(Config *c) {
+    memset(c, 0, sizeof(*c));
+    c->nmgr = 3;
+    c->ngroups = 2;
+    c->coterie = COT_MAJORITY;
+    c->home = HOME_LEGACY;
+    c->progress = PROGRESS_THREAD;
+    c->clients = 1;
+    c->pick = PICK_LOAD;
+    c->admit = ADMIT_FCFS;
+    c->admit_bypass = 16;
+    c->trace_level = -1;
+    c->trace_buf = 1 << 16;
+    strcpy(c->trace_prefix, "trace");
+    wl_defaults(&c->wl);
+}
+
+void cfg_free(Config *c) { wl_free(&c->wl); }
+
+int cfg_parse_int(const char *s, int min, int *out) {
+    char *end;
+    long v = strtol(s, &end, 10);
+    if (end == s || *end || v < min || v > 1 << 30) return -1;
+    *out = (int)v;
+    return 0;
+}
+
+static int parse_seconds(const char *s, double *out) {
+    char *end;
+    double v = strtod(s, &end);
+    if (end == s || *end || v < 0) return -1;
+    *out = v;
+    return 0;
+}
+
+static int copy_str(char *dst, size_t size, const char *s) {
+    if (strlen(s) >= size) return -1;
+    strcpy(dst, s);
+    return 0;
+}
+
+static int parse_home(Config *c, const char *s) {
+    if (strcmp(s, "legacy") == 0) { c->home = HOME_LEGACY; return 0; }
+    if (strcmp(s, "rr") == 0) { c->home = HOME_RR; return 0; }
+    if (strncmp(s, "random:", 7) == 0 && cfg_parse_int(s + 7, 1, &c->home_k) == 0) {
+        c->home = HOME_RANDOM;
+        return 0;
+    }
+    return -1;
+}
+
+static int parse_progress(Config *c, const char *s) {
+    if (strcmp(s, "thread") == 0) { c->progress = PROGRESS_THREAD; return 0; }
+    if (strcmp(s, "inline") == 0) { c->progress = PROGRESS_INLINE; return 0; }
+    return -1;
+}
+
+static int parse_pick(Config *c, const char *s) {
+    if (strcmp(s, "load") == 0) { c->pick = PICK_LOAD; return 0; }
+    if (strcmp(s, "hash") == 0) { c->pick = PICK_HASH; return 0; }
+    return -1;
+}
+
+static int parse_admit(Config *c, const char *s) {
+    if (strcmp(s, "fcfs") == 0) { c->admit = ADMIT_FCFS; return 0; }
+    AdmitKind k;
+    if (strncmp(s, "batch", 5) == 0) { k = ADMIT_BATCH; s += 5; }
+    else if (strncmp(s, "largest", 7) == 0) { k = ADMIT_LARGEST; s += 7; }
+    else return -1;
+    if (*s == ':' && cfg_parse_int(s + 1, 1, &c->admit_bypass)) return -1;
+    if (*s && *s != ':') return -1;
+    c->admit = k;
+    return 0;
+}
+
+static int parse_metrics_format(Config *c, const char *s) {
+    if (strcmp(s, "json") == 0) { c->metrics_prom = 0; return 0; }
+    if (strcmp(s, "prom") == 0) { c->metrics_prom = 1; return 0; }
+    return -1;
+}
+
+static int load_file(Config *c, const char *path, int depth, char *err, size_t errlen);
+
+static int parse_arg(Config *c, const char *a, int depth, char *err, size_t errlen) {
+    int rc = 1;
+    if (strncmp(a, "--managers=", 11) == 0) rc = cfg_parse_int(a + 11, 1, &c->nmgr) ? -1 : 1;
+    else if (strncmp(a, "--groups=", 9) == 0) rc = cfg_parse_int(a + 9, 1, &c->ngroups) ? -1 : 1;
+    else if (strncmp(a, "--coterie=", 10) == 0) rc = cot_parse_kind(a + 10, &c->coterie) ? -1 : 1;
+    else if (strncmp(a, "--home=", 7) == 0) rc = parse_home(c, a + 7) ? -1 : 1;
+    else if (strncmp(a, "--progress=", 11) == 0) rc = parse_progress(c, a + 11) ? -1 : 1;
+    else if (strncmp(a, "--clients=", 10) == 0) rc = cfg_parse_int(a + 10, 1, &c->clients) ? -1 : 1;
+    else if (strcmp(a, "--symmetric") == 0) c->symmetric = 1;
+    else if (strncmp(a, "--lease=", 8) == 0) rc = parse_seconds(a + 8, &c->lease) ? -1 : 1;
+    else if (strncmp(a, "--quorum-pick=", 14) == 0) rc = parse_pick(c, a + 14) ? -1 : 1;
+    else if (strncmp(a, "--hedge=", 8) == 0) rc = parse_seconds(a + 8, &c->hedge) ? -1 : 1;
+    else if (strcmp(a, "--rma") == 0) c->rma = 1;
+    else if (strncmp(a, "--cohort=", 9) == 0) rc = cfg_parse_int(a + 9, 0, &c->cohort) ? -1 : 1;
+    else if (strncmp(a, "--hier=", 7) == 0) rc = cfg_parse_int(a + 7, 0, &c->hier) ? -1 : 1;
+    else if (strncmp(a, "--admit=", 8) == 0) rc = parse_admit(c, a + 8) ? -1 : 1;
+    else if (strcmp(a, "--bench") == 0) c->bench = 1;
+    else if (strncmp(a, "--out=", 6) == 0) rc = copy_str(c->out, sizeof(c->out), a + 6) ? -1 : 1;
+    else if (strncmp(a, "--trace=", 8) == 0) rc = cfg_parse_int(a + 8, 0, &c->trace_level) ? -1 : 1;
+    else if (strncmp(a, "--trace-file=", 13) == 0)
+        rc = copy_str(c->trace_prefix, sizeof(c->trace_prefix), a + 13) ? -1 : 1;
+    else if (strncmp(a, "--trace-buf=", 12) == 0) rc = cfg_parse_int(a + 12, 1, &c->trace_buf) ? -1 : 1;
+    else if (strncmp(a, "--metrics=", 10) == 0) rc = copy_str(c->metrics, sizeof(c->metrics), a + 10) ? -1 : 1;
+    else if (strncmp(a, "--metrics-format=", 17) == 0) rc = parse_metrics_format(c, a + 17) ? -1 : 1;
+    else if (strncmp(a, "--metrics-every=", 16) == 0) rc = parse_seconds(a + 16, &c->metrics_every) ? -1 : 1;
+    else if (strncmp(a, "--config=", 9) == 0) return load_file(c, a + 9, depth + 1, err, errlen) ? -1 : 1;
+    else rc = wl_parse_arg(&c->wl, a);
+
+    if (rc == 0) snprintf(err, errlen, "unknown option %s", a);
+    if (rc < 0) snprintf(err, errlen, "bad value in %s", a);
+    return rc;
+}
+
+int cfg_parse_arg(Config *c, const char *arg, char *err, size_t errlen) {
+    return parse_arg(c, arg, 0, err, errlen);
+}
+
+/* each line "key = value" or "key" becomes --key=value / --key */
+static int load_file(Config *c, const char *path, int depth, char *err, size_t errlen) {
+    if (depth > CONFIG_DEPTH) { snprintf(err, errlen, "%s: --config nested too deep", path); return -1; }
+    FILE *f = fopen(path, "r");
+    if (!f) { snprintf(err, errlen, "cannot open config %s", path); return -1; }
+
+    char line[1024], opt[1100];
+    int lineno = 0, rc = 0;
+    while (rc == 0 && fgets(line, sizeof(line), f)) {
+        ++lineno;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+
+        char *key = line;
+        while (isspace((unsigned char)*key)) ++key;
+        char *end = key + strlen(key);
+        while (end > key && isspace((unsigned char)end[-1])) *--end = '\0';
+        if (!*key) continue;
+
+        char *val = strchr(key, '=');
+        if (val) {
+            char *kend = val;
+            while (kend > key && isspace((unsigned char)kend[-1])) --kend;
+            *kend = '\0';
+            ++val;
+            while (isspace((unsigned char)*val)) ++val;
+            snprintf(opt, sizeof(opt), "--%s=%s", key, val);
+        } else {
+            snprintf(opt, sizeof(opt), "--%s", key);
+        }
+
+        char sub[256];
+        if (parse_arg(c, opt, depth, sub, sizeof(sub)) != 1) {
+            snprintf(err, errlen, "%s:%d: %s", path, lineno, sub);
+            rc = -1;
+        }
+    }
+    fclose(f);
+    return rc;
+}
+
+int cfg_check(const Config *c, int world, char *err, size_t errlen) {
+    if (!c->symmetric && world <= c->nmgr) {
+        snprintf(err, errlen, "need at least %d managers + 1 requester (have %d ranks)", c->nmgr, world);
+        return -1;
+    }
+    if (wl_check(&c->wl, c->ngroups) != 0) {
+        snprintf(err, errlen, "--mix names a group outside 0..%d", c->ngroups - 1);
+        return -1;
+    }
+    if (c->cohort > 0xffff || (c->cohort && c->ngroups >= 0x3fff)) {
+        snprintf(err, errlen, "--cohort takes at most 65535 joins and 16382 groups");
+        return -1;
+    }
+    if (c->rma && c->ngroups >= 0x3fffffff) {
+        snprintf(err, errlen, "--rma takes at most 1073741822 groups");
+        return -1;
+    }
+    if (c->hier && (c->rma || c->cohort)) {
+        snprintf(err, errlen, "--hier takes the place of --rma and --cohort");
+        return -1;
+    }
+    if (c->wl.hold > c->wl.resources) {
+        snprintf(err, errlen, "--hold=%d needs at least that many --resources", c->wl.hold);
+        return -1;
+    }
+    if ((long long)world * c->clients > 1 << 30) {
+        snprintf(err, errlen, "--clients=%d is too many for %d ranks", c->clients, world);
+        return -1;
+    }
+    if (c->home == HOME_RANDOM && c->home_k > c->ngroups) {
+        snprintf(err, errlen, "--home=random:%d needs at least that many groups", c->home_k);
+        return -1;
+    }
+    if (c->metrics_every > 0 && (!c->metrics[0] || strcmp(c->metrics, "-") == 0)) {
+        snprintf(err, errlen, "--metrics-every needs --metrics=FILE");
+        return -1;
+    }
+    return 0;
+}
+
+void cfg_usage(FILE *f, const char *prog) {
+    fprintf(f, "usage: %s [--config=FILE] [--managers=N] [--groups=N] [--coterie=majority|grid|fpp|tree]\n"
+               "       [--home=legacy|rr|random:K] [--progress=thread|inline] [--clients=N]\n"
+               "       [--symmetric] [--lease=S] [--quorum-pick=load|hash] [--hedge=S]\n"
+               "       [--admit=fcfs|batch[:K]|largest[:K]] [--rma] [--cohort=K] [--hier=K]\n"
+               "       [--bench] [--out=FILE] [--trace=0|1|2] [--trace-file=PREFIX] [--trace-buf=EVENTS]\n"
+               "       [--metrics=FILE|-] [--metrics-format=json|prom] [--metrics-every=S]\n"
+               "       [--arrival=closed|poisson|bursty] [--think=S] [--burst=N]\n"
+               "       [--cs=S] [--cs-exp] [--duration=S] [--seed=N] [--mix=0:5,1:3,0+1:2]\n"
+               "       [--resources=N] [--hold=K] [--entries=K] [--replay=FILE]\n",
+            prog);
+}
+
+static uint64_t splitmix(uint64_t *s) {
+    uint64_t z = (*s += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+void cfg_home_set(const Config *c, int rid, uint64_t *gs) {
+    int i = rid - (c->symmetric ? 0 : c->nmgr) * c->clients, g = c->ngroups;
+    gs_zero(gs, GSET_WORDS(g));
+    switch (c->home) {
+        case HOME_LEGACY:
+            if (i == 0) gs_set(gs, 0);
+            else if (i == 1) { gs_set(gs, 0); gs_set(gs, 1 % g); }
+            else gs_set(gs, 1 % g);
+            break;
+        case HOME_RR:
+            gs_set(gs, i % g);
+            break;
+        case HOME_RANDOM: {
+            /* rejection is fine: k <= g, and sets are drawn once per rank */
+            uint64_t s = c->wl.seed ^ ((uint64_t)rid << 32);
+            for (int n = 0; n < c->home_k; ) {
+                int x = (int)(splitmix(&s) % (uint64_t)g);
+                if (!gs_test(gs, x)) { gs_set(gs, x); ++n; }
+            }
+            break;
+        }
+    }
+}
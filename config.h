@@ -0,0 +1,120 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+/**************************************************************************
+ * config - run parameters from the command line and config files
+ *
+ * every option is --key=value (or --key for flags). --config=FILE reads
+ * the same keys from a file, one per line as `key = value` or `key`,
+ * with # comments; later options override earlier ones, so
+ *   --config=base.cfg --managers=64
+ * runs base.cfg with 64 managers.
+ *
+ * --symmetric makes every rank both a manager and a requester (the
+ * paper's model): --managers is ignored and the coterie spans all ranks.
+ *
+ * --clients=N runs N logical requesters on every requester rank, each
+ * with its own request in flight; they are numbered rank * N + client.
+ *
+ * home sets (the group set a requester asks for when the workload has no
+ * --mix), for requester i = rid - managers * clients (i = rid when
+ * symmetric):
+ *   legacy    i=0 {g0}, i=1 {g0, g1}, others {g1}
+ *   rr        {g(i mod groups)}
+ *   random:K  K distinct groups drawn from --seed
+ *
+ * --lease=S lets a pivot keep its session for up to S seconds after
+ * releasing, to re-enter without messages (see gme.h); 0 (default) is off.
+ *
+ * --quorum-pick=load (default) sends each request to the less loaded of
+ * two quorums: the hashed one and one drawn at random, by the loads the
+ * managers last reported; hash always uses the hashed one.
+ *
+ * --hedge=S asks an alternate quorum when a request is not granted
+ * within S seconds, up to twice; the first quorum whose members all
+ * answer is locked (see gme.h). 0 (default) is off.
+ *
+ * --admit=fcfs (default) admits into a session only the compatible
+ * requests the pivot outranks (the paper's rule); batch admits every
+ * compatible request until K (default 16) have gone past one the session
+ * cannot take in; largest also locks the group most requests wait for
+ * (see mgr.c). K is given as batch:K / largest:K.
+ *
+ * --rma lets a requester take an uncontended resource with atomic
+ * compare-and-swaps on its quorum's state words, with no message to the
+ * managers (see proto.h); gme_mpi only.
+ *
+ * --cohort=K lets requesters on one node join a session another of
+ * them holds, through a shared-memory word and without asking the
+ * managers, up to K joins per session (see gme.h); 0 (default) is off,
+ * gme_mpi only.
+ *
+ * --hier=K puts a sub-manager on every node: the node's requesters send
+ * it their requests, and it asks the managers once per resource for all
+ * of them (see sub.h), letting up to K later local requests join a grant
+ * before it goes back; 0 (default) is off, gme_mpi only,
+ * and it takes the place of --rma and --cohort.
+ *
+ * --progress=thread (default) runs each requester's protocol on a
+ * progress thread beside the application (see gme.h); inline drives it
+ * from the application's own acquire/release calls.
+ *
+ * --metrics=FILE sums every rank's counters (metrics.h) at exit and
+ * writes them to FILE ("-" = stdout) as JSON, or as Prometheus text with
+ * --metrics-format=prom. --metrics-every=S also has each rank append a
+ * snapshot of its own counters to FILE.RANK every S seconds.
+ **************************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bench.h"
+#include "coterie.h"
+
+typedef enum { HOME_LEGACY, HOME_RR, HOME_RANDOM } HomeKind;
+typedef enum { PROGRESS_THREAD, PROGRESS_INLINE } ProgressKind;
+typedef enum { PICK_LOAD, PICK_HASH } PickKind;
+typedef enum { ADMIT_FCFS, ADMIT_BATCH, ADMIT_LARGEST } AdmitKind;
+
+typedef struct {
+    int nmgr;               /* managers are ranks 0..nmgr-1 (all when symmetric) */
+    int ngroups;
+    CoterieKind coterie;
+    HomeKind home;
+    int home_k;             /* groups per requester for HOME_RANDOM */
+    ProgressKind progress;  /* requester protocol on its own thread or inline */
+    int clients;            /* logical requesters per requester rank */
+    int symmetric;          /* every rank runs both roles */
+    double lease;           /* seconds a released pivot keeps its session, 0 = off */
+    PickKind pick;          /* how requesters choose a quorum */
+    double hedge;           /* seconds before asking another quorum, 0 = off */
+    int rma;                /* one-sided fast path for uncontended acquires */
+    int cohort;             /* local joins per node-local session, 0 = off */
+    int hier;               /* sub-manager joins per grant, 0 = off */
+    AdmitKind admit;        /* which queued requests join a session */
+    int admit_bypass;       /* batch/largest: admissions past a blocked request */
+    int bench;
+    char out[256];          /* bench report file, "" = stdout */
+    int trace_level;        /* -1 = default for the mode */
+    int trace_buf;
+    char trace_prefix[256];
+    char metrics[256];      /* metrics report file, "" = none, "-" = stdout */
+    int metrics_prom;       /* Prometheus text instead of JSON */
+    double metrics_every;   /* seconds between per-rank snapshots, 0 = none */
+    Workload wl;
+} Config;
+
+void cfg_defaults(Config *c);
+void cfg_free(Config *c);
+/* a whole decimal string in min..2^30 into *out: 0 ok, -1 otherwise.
+   every integer option goes through it */
+int  cfg_parse_int(const char *s, int min, int *out);
+/* 1 consumed, 0 not an option we know, -1 bad value; err gets a message */
+int  cfg_parse_arg(Config *c, const char *arg, char *err, size_t errlen);
+/* 0 ok, -1 with err set */
+int  cfg_check(const Config *c, int world, char *err, size_t errlen);
+void cfg_usage(FILE *f, const char *prog);
+
+/* home set of logical requester rid (gs has GSET_WORDS(ngroups) words) */
+void cfg_home_set(const Config *c, int rid, uint64_t *gs);
+
+#endif
@@ -0,0 +1,198 @@
+#include "coterie.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *KIND_NAMES[] = { "majority", "grid", "fpp", "tree" };
+
+int cot_parse_kind(const char *s, CoterieKind *out) {
+    for (int k = 0; k < (int)(sizeof(KIND_NAMES) / sizeof(KIND_NAMES[0])); ++k)
+        if (strcmp(s, KIND_NAMES[k]) == 0) { *out = (CoterieKind)k; return 0; }
+    return -1;
+}
+
+const char *cot_kind_name(CoterieKind k) { return KIND_NAMES[k]; }
+
+/* builder: appends quorums, dropping repeated members */
+typedef struct {
+    Coterie *c;
+    int qcap, mcap;
+    unsigned char *seen;    /* nmgr marks, cleared after every quorum */
+} Builder;
+
+static int cmp_int(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+static int add_quorum(Builder *b, const int *set, int n) {
+    Coterie *c = b->c;
+    if (c->nq + 1 >= b->qcap) {
+        b->qcap = b->qcap ? 2 * b->qcap : 64;
+        int *o = realloc(c->off, b->qcap * sizeof(int));
+        if (!o) return -1;
+        c->off = o;
+    }
+    if (c->off[c->nq] + n > b->mcap) {
+        while (c->off[c->nq] + n > b->mcap) b->mcap = b->mcap ? 2 * b->mcap : 256;
+        int *m = realloc(c->members, b->mcap * sizeof(int));
+        if (!m) return -1;
+        c->members = m;
+    }
+    int start = c->off[c->nq], k = start;
+    for (int i = 0; i < n; ++i) {
+        if (b->seen[set[i]]) continue;
+        b->seen[set[i]] = 1;
+        c->members[k++] = set[i];
+    }
+    for (int i = start; i < k; ++i) b->seen[c->members[i]] = 0;
+    qsort(c->members + start, k - start, sizeof(int), cmp_int);
+    c->off[++c->nq] = k;
+    return 0;
+}
+
+static int build_majority(Builder *b, int n, int *tmp) {
+    int k = n / 2 + 1;
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < k; ++j) tmp[j] = (i + j) % n;
+        if (add_quorum(b, tmp, k)) return -1;
+    }
+    return 0;
+}
+
+/* row + column of a ceil(sqrt n) wide grid; a short last row still
+   intersects every column, so all quorums meet */
+static int build_grid(Builder *b, int n, int *tmp) {
+    int w = 1;
+    while (w * w < n) ++w;
+    for (int m = 0; m < n; ++m) {
+        int row = m / w, col = m % w, k = 0;
+        for (int j = row * w; j < row * w + w && j < n; ++j) tmp[k++] = j;
+        for (int j = col; j < n; j += w) tmp[k++] = j;
+        if (add_quorum(b, tmp, k)) return -1;
+    }
+    return 0;
+}
+
+static int is_prime(int q) {
+    if (q < 2) return 0;
+    for (int d = 2; d * d <= q; ++d) if (q % d == 0) return 0;
+    return 1;
+}
+
+/* lines of PG(2,q): points and lines are normalised triples over GF(q),
+   point p lies on line l iff p.l == 0 (mod q) */
+static int build_fpp(Builder *b, int n, int *tmp) {
+    int q = 2;
+    while (q * q + q + 1 < n || !is_prime(q)) ++q;
+    int np = q * q + q + 1;
+    int (*pt)[3] = malloc(np * sizeof(*pt));
+    if (!pt) return -1;
+    int k = 0;
+    for (int x = 0; x < q; ++x)
+        for (int y = 0; y < q; ++y) { pt[k][0] = 1; pt[k][1] = x; pt[k][2] = y; ++k; }
+    for (int y = 0; y < q; ++y) { pt[k][0] = 0; pt[k][1] = 1; pt[k][2] = y; ++k; }
+    pt[k][0] = 0; pt[k][1] = 0; pt[k][2] = 1;
+
+    for (int l = 0; l < np; ++l) {
+        int m = 0;
+        for (int p = 0; p < np; ++p)
+            if ((pt[p][0] * pt[l][0] + pt[p][1] * pt[l][1] + pt[p][2] * pt[l][2]) % q == 0)
+                tmp[m++] = p % n;
+        if (add_quorum(b, tmp, m)) { free(pt); return -1; }
+    }
+    free(pt);
+    return 0;
+}
+
+/* nodes from leaf up to (and including) subtree root s */
+static int tree_path(int s, int leaf, int *out) {
+    int k = 0;
+    for (int v = leaf; ; v = (v - 1) / 2) {
+        out[k++] = v;
+        if (v == s || v == 0) break;
+    }
+    return k;
+}
+
+static int tree_leaves(int s, int n, int *out) {
+    if (s >= n) return 0;
+    if (2 * s + 1 >= n) { out[0] = s; return 1; }
+    int k = tree_leaves(2 * s + 1, n, out);
+    return k + tree_leaves(2 * s + 2, n, out + k);
+}
+
+static int build_tree(Builder *b, int n, int *tmp) {
+    int *lv = malloc(2 * n * sizeof(int));
+    if (!lv) return -1;
+    int nl = tree_leaves(0, n, lv);
+    for (int i = 0; i < nl; ++i) {
+        int k = tree_path(0, lv[i], tmp);
+        if (add_quorum(b, tmp, k)) { free(lv); return -1; }
+    }
+    /* root substituted by one path through each child subtree */
+    if (n >= 3) {
+        int *ll = lv + nl;
+        int nll = tree_leaves(1, n, ll);
+        int nrl = tree_leaves(2, n, ll + nll);
+        int *rl = ll + nll;
+        int cnt = nll > nrl ? nll : nrl;
+        for (int i = 0; i < cnt; ++i) {
+            int k = tree_path(1, ll[i % nll], tmp);
+            k += tree_path(2, rl[i % nrl], tmp + k);
+            if (add_quorum(b, tmp, k)) { free(lv); return -1; }
+        }
+    }
+    free(lv);
+    return 0;
+}
+
+int cot_build(Coterie *c, CoterieKind kind, int nmgr) {
+    memset(c, 0, sizeof(*c));
+    if (nmgr < 1) return -1;
+    c->kind = kind;
+    c->nmgr = nmgr;
+
+    Builder b = { c, 0, 0, calloc(nmgr, 1) };
+    int *tmp = malloc(2 * nmgr * sizeof(int) + 64 * sizeof(int));
+    c->off = calloc(1, sizeof(int));
+    int rc = -1;
+    if (b.seen && tmp && c->off) {
+        switch (kind) {
+            case COT_MAJORITY: rc = build_majority(&b, nmgr, tmp); break;
+            case COT_GRID:     rc = build_grid(&b, nmgr, tmp); break;
+            case COT_FPP:      rc = build_fpp(&b, nmgr, tmp); break;
+            case COT_TREE:     rc = build_tree(&b, nmgr, tmp); break;
+        }
+    }
+    free(b.seen);
+    free(tmp);
+    if (rc) cot_free(c);
+    return rc;
+}
+
+void cot_free(Coterie *c) {
+    free(c->off);
+    free(c->members);
+    memset(c, 0, sizeof(*c));
+}
+
+int cot_check(const Coterie *c) {
+    unsigned char *mark = calloc(c->nmgr, 1);
+    if (!mark) return 0;
+    int ok = 1;
+    for (int i = 0; i < c->nq && ok; ++i) {
+        int ni; const int *qi = cot_quorum(c, i, &ni);
+        for (int k = 0; k < ni; ++k) mark[qi[k]] = 1;
+        for (int j = i + 1; j < c->nq && ok; ++j) {
+            int nj; const int *qj = cot_quorum(c, j, &nj);
+            int hit = 0;
+            for (int k = 0; k < nj && !hit; ++k) hit = mark[qj[k]];
+            ok = hit;
+        }
+        for (int k = 0; k < ni; ++k) mark[qi[k]] = 0;
+    }
+    free(mark);
+    return ok;
+}
@@ -0,0 +1,48 @@
+#ifndef COTERIE_H
+#define COTERIE_H
+
+/**************************************************************************
+ * coterie - quorum systems over managers 0..nmgr-1, built at startup
+ *
+ *   majority  rotating windows of floor(n/2)+1 managers (n=3 gives the
+ *             classic {0,1} {1,2} {2,0})
+ *   grid      managers on a ceil(sqrt n) wide grid, quorum = row + column
+ *   fpp       lines of the projective plane PG(2,q), q prime (Maekawa);
+ *             points beyond n fold back onto real managers
+ *   tree      Agrawal-El Abbadi over a complete binary tree: root-to-leaf
+ *             paths, plus root-free quorums through both subtrees
+ *
+ * every two quorums intersect; cot_check() verifies it.
+ **************************************************************************/
+
+typedef enum { COT_MAJORITY, COT_GRID, COT_FPP, COT_TREE } CoterieKind;
+
+typedef struct {
+    CoterieKind kind;
+    int nmgr;
+    int nq;         /* number of quorums */
+    int *off;       /* quorum i is members[off[i] .. off[i+1]) */
+    int *members;
+} Coterie;
+
+int  cot_build(Coterie *c, CoterieKind kind, int nmgr);   /* 0 ok, -1 on error */
+void cot_free(Coterie *c);
+int  cot_check(const Coterie *c);                         /* 1 if all quorums intersect */
+
+int  cot_parse_kind(const char *s, CoterieKind *out);     /* 0 ok, -1 unknown */
+const char *cot_kind_name(CoterieKind k);
+
+static inline const int *cot_quorum(const Coterie *c, int i, int *n) {
+    *n = c->off[i + 1] - c->off[i];
+    return c->members + c->off[i];
+}
+
+/* largest quorum size (for sizing per-request arrays) */
+static inline int cot_max_qsize(const Coterie *c) {
+    int m = 0;
+    for (int i = 0; i < c->nq; ++i)
+        if (c->off[i + 1] - c->off[i] > m) m = c->off[i + 1] - c->off[i];
+    return m;
+}
+
+#endif
@@ -0,0 +1,652 @@
+#include "gme.h"
+#include "gset.h"
+#include "metrics.h"
+#include "mgr.h"
+#include "proto.h"
+#include "req.h"
+#include "sub.h"
+#include "trace.h"
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* one logical requester (application side, under Gme.mu) */
+typedef struct {
+    int rid;
+    int app_seq;
+    int *gave_up; int ngave, gcap;  /* requests the caller timed out on */
+} Client;
+
+typedef struct { int c, res, seq, group, live; } Ready;
+
+/* a resource a client holds on the fast path (protocol side) */
+typedef struct {
+    int c, res, qi;
+    int64_t *held;          /* the words written, one per quorum member */
+} FastHold;
+
+/* a client's part in the node's cohort on res (protocol side) */
+enum { CO_JOINED, CO_WAIT, CO_IN, CO_OUT };
+typedef struct {
+    int c, res, seq, group;
+    int st;                 /* CO_JOINED, or as the leader: asked, in, out
+                               but keeping the grant for the node */
+} CoHold;
+
+struct Gme {
+    const Config *cfg;
+    const Coterie *cot;
+    int rank, gw, threaded;
+    int n;
+    Client *cl;
+
+    /* protocol side */
+    Progress pe;
+    Fanout fo;
+    Out out;                        /* sends of the current step */
+    int lamport;                    /* shared by the rank's clients */
+    uint64_t *mgs;                  /* payload of the current message */
+    Req *req;
+    int closing, closed;
+    Term td;                        /* end of the job, once closed */
+    Mgr *mgr;                       /* the rank's manager, when symmetric */
+    Fast fp;
+    FastHold *fh; int nfh, fhcap;   /* grants taken on the fast path */
+    Cohort co;
+    CoHold *ch; int nch, chcap;     /* joins and leads of the cohort */
+    int sub_rank;                   /* hier: the node's sub-manager ... */
+    Sub *sub;                       /* ... when it runs on this rank */
+    int *sh; int nsh, shcap;        /* hier: client, res pairs let in */
+    int maxq;
+
+    /* application side */
+    unsigned char *app_wire;
+    pthread_t thr;
+
+    /* handshake */
+    pthread_mutex_t mu;
+    pthread_cond_t cv;
+    Ready *rdy;                     /* grants in order, for gme_wait_any */
+    int rhead, rn, rcap;
+};
+
+/**************************************************************************
+ * grant queue (under mu). entries whose grant was already picked up by
+ * gme_acquire stay behind, dead, and are skipped.
+ **************************************************************************/
+static void rdy_push(Gme *g, Ready e) {
+    if (g->rn == g->rcap) {
+        /* drop dead entries, grow only if the live ones fill half */
+        int live = 0;
+        for (int i = 0; i < g->rn; ++i) live += g->rdy[(g->rhead + i) % g->rcap].live;
+        int cap = live * 2 >= g->rcap ? (g->rcap ? 2 * g->rcap : 16) : g->rcap;
+        Ready *r = xrealloc(NULL, cap * sizeof(Ready));
+        int k = 0;
+        for (int i = 0; i < g->rn; ++i) {
+            Ready x = g->rdy[(g->rhead + i) % g->rcap];
+            if (x.live) r[k++] = x;
+        }
+        free(g->rdy);
+        g->rdy = r; g->rcap = cap; g->rhead = 0; g->rn = k;
+    }
+    g->rdy[(g->rhead + g->rn) % g->rcap] = e;
+    ++g->rn;
+}
+
+static int rdy_pop(Gme *g, Ready *out) {
+    while (g->rn) {
+        Ready e = g->rdy[g->rhead];
+        g->rhead = (g->rhead + 1) % g->rcap;
+        --g->rn;
+        if (!e.live) continue;
+        *out = e;
+        return 1;
+    }
+    return 0;
+}
+
+/* pick up the grant of client c's request seq, wherever it sits */
+static int rdy_take(Gme *g, int c, int seq, int *group) {
+    for (int i = 0; i < g->rn; ++i) {
+        Ready *e = &g->rdy[(g->rhead + i) % g->rcap];
+        if (!e->live || e->c != c || e->seq != seq) continue;
+        e->live = 0;
+        *group = e->group;
+        return 1;
+    }
+    return 0;
+}
+
+/* timed-out requests (under mu); a request is looked up once, when it
+   is issued or granted, and forgotten then */
+static void gave_up_add(Client *cl, int seq) {
+    if (cl->ngave == cl->gcap) {
+        cl->gcap = cl->gcap ? 2 * cl->gcap : 4;
+        cl->gave_up = xrealloc(cl->gave_up, cl->gcap * sizeof(int));
+    }
+    cl->gave_up[cl->ngave++] = seq;
+}
+static int gave_up_take(Client *cl, int seq) {
+    for (int i = 0; i < cl->ngave; ++i)
+        if (cl->gave_up[i] == seq) { cl->gave_up[i] = cl->gave_up[--cl->ngave]; return 1; }
+    return 0;
+}
+
+/**************************************************************************
+ * protocol side: req.c's hooks, and the steps of the rank's loop
+ **************************************************************************/
+/* CS granted: hand it to the caller unless it stopped waiting */
+static int on_grant(void *ctx, int c, int res, int seq, int group) {
+    Gme *g = ctx;
+    pthread_mutex_lock(&g->mu);
+    int abandoned = gave_up_take(&g->cl[c], seq);
+    if (!abandoned) {
+        rdy_push(g, (Ready){ c, res, seq, group, 1 });
+        pthread_cond_broadcast(&g->cv);
+    }
+    pthread_mutex_unlock(&g->mu);
+    return !abandoned;
+}
+
+static int on_gave_up(void *ctx, int c, int seq) {
+    Gme *g = ctx;
+    pthread_mutex_lock(&g->mu);
+    int abandoned = gave_up_take(&g->cl[c], seq);
+    pthread_mutex_unlock(&g->mu);
+    return abandoned;
+}
+
+/* 1 if client c held res on the fast path, now released */
+static int fast_release(Gme *g, int c, int res) {
+    for (int i = 0; i < g->nfh; ++i) {
+        FastHold *h = &g->fh[i];
+        if (h->c != c || h->res != res) continue;
+        int qn; const int *q = cot_quorum(g->cot, h->qi, &qn);
+        fp_release(&g->fp, q, qn, res, h->held);
+        TRACE(EV_REQ_FAST_OUT, g->lamport, g->cl[c].rid, res, h->qi);
+        /* swap the entry out, keeping its buffer for reuse */
+        FastHold x = *h;
+        *h = g->fh[--g->nfh];
+        g->fh[g->nfh] = x;
+        return 1;
+    }
+    return 0;
+}
+
+/* fast path: take res with one CAS per member of the client's quorum.
+   1 if granted (or given back at once to a caller that stopped waiting) */
+static int fast_request(Gme *g, int c, int res, int seq, const uint64_t *gs) {
+    int rid = g->cl[c].rid, qn;
+    int qi = req_quorum(g->req, rid, res, gs);
+    const int *q = cot_quorum(g->cot, qi, &qn);
+
+    if (g->nfh == g->fhcap) {
+        g->fhcap = g->fhcap ? 2 * g->fhcap : 8;
+        g->fh = xrealloc(g->fh, g->fhcap * sizeof(FastHold));
+        for (int i = g->nfh; i < g->fhcap; ++i) g->fh[i].held = xrealloc(NULL, g->maxq * sizeof(int64_t));
+    }
+    FastHold *h = &g->fh[g->nfh];
+    int group = fp_acquire(&g->fp, q, qn, res, gs, g->gw, h->held);
+    if (group < 0) {
+        ++mt.fast_miss;
+        TRACE(EV_REQ_FAST_MISS, g->lamport, rid, res, qi);
+        return 0;
+    }
+    ++mt.fast_hit;
+    TRACE(EV_REQ_FAST, g->lamport, rid, res, group, qi);
+    h->c = c; h->res = res; h->qi = qi;
+    ++g->nfh;
+    if (!on_grant(g, c, res, seq, group)) {
+        TRACE(EV_REQ_ABANDON, g->lamport, rid, seq, res);
+        fast_release(g, c, res);
+    }
+    return 1;
+}
+
+/* cohort: client c's entry on res in state st (-1: any), or NULL */
+static CoHold *co_find(Gme *g, int c, int res, int st) {
+    for (int i = 0; i < g->nch; ++i) {
+        CoHold *h = &g->ch[i];
+        if (h->c == c && h->res == res && (st < 0 || h->st == st)) return h;
+    }
+    return NULL;
+}
+
+static CoHold *co_add(Gme *g, int c, int res, int seq, int group, int st) {
+    if (g->nch == g->chcap) {
+        g->chcap = g->chcap ? 2 * g->chcap : 8;
+        g->ch = xrealloc(g->ch, g->chcap * sizeof(CoHold));
+    }
+    CoHold *h = &g->ch[g->nch++];
+    *h = (CoHold){ c, res, seq, group, st };
+    return h;
+}
+
+static void co_drop(Gme *g, CoHold *h) { *h = g->ch[--g->nch]; }
+
+/* no one of the node is in res any more: the leader gives its grant back.
+   the last request out may have come back in since, then it waits */
+static void cohort_end(Gme *g, int res) {
+    for (int i = 0; i < g->nch; ++i) {
+        CoHold *h = &g->ch[i];
+        if (h->res != res || h->st != CO_OUT) continue;
+        if (!co_end(&g->co, res)) return;
+        int c = h->c;
+        co_drop(g, h);
+        TRACE(EV_REQ_COHORT_END, g->lamport, g->cl[c].rid, res);
+        req_release(g->req, c, res, MPI_Wtime(), &g->out);
+        return;
+    }
+}
+
+/* client c leaves res's cohort; the last one out has its leader release */
+static void cohort_leave(Gme *g, CoHold *h) {
+    int res = h->res;
+    if (h->st == CO_IN) h->st = CO_OUT;
+    else {
+        TRACE(EV_REQ_CS_FOL_OUT, g->lamport, g->cl[h->c].rid, res, h->group);
+        co_drop(g, h);
+    }
+    int lead = co_leave(&g->co, res);
+    if (lead == g->rank) cohort_end(g, res);
+    else if (lead >= 0) {
+        Msg m = { 0, g->rank, -1, 0, 0, -1, res, 0 };
+        out_send(&g->out, &m, lead, TAG_COHORT, ++g->lamport);
+    }
+}
+
+/* join a node-mate's grant on res. 1 if granted (or given back at once
+   to a caller that stopped waiting) */
+static int cohort_join(Gme *g, int c, int res, int seq, const uint64_t *gs) {
+    int group = co_join(&g->co, res, gs, g->cfg->cohort);
+    if (group < 0) return 0;
+    ++mt.cohort_join;
+    TRACE(EV_REQ_COHORT_JOIN, g->lamport, g->cl[c].rid, res, group);
+    CoHold *h = co_add(g, c, res, seq, group, CO_JOINED);
+    if (!on_grant(g, c, res, seq, group)) {
+        TRACE(EV_REQ_ABANDON, g->lamport, g->cl[c].rid, seq, res);
+        cohort_leave(g, h);
+    }
+    return 1;
+}
+
+/* hier: tell the node's sub-manager about client c's request or release */
+static void sub_send(Gme *g, int tag, int c, int res, int seq, const uint64_t *gs) {
+    Msg m = { seq, g->rank, -1, gs ? g->gw : 0, 0, g->cl[c].rid, res, 0 };
+    out_multicast(&g->out, &m, gs, gs ? g->gw : 0, &g->sub_rank, 1, tag, ++g->lamport);
+}
+
+/* hier: client c is out of res */
+static void sub_leave(Gme *g, int c, int res) {
+    for (int i = 0; i < g->nsh; ++i) {
+        if (g->sh[2 * i] != c || g->sh[2 * i + 1] != res) continue;
+        --g->nsh;
+        g->sh[2 * i] = g->sh[2 * g->nsh];
+        g->sh[2 * i + 1] = g->sh[2 * g->nsh + 1];
+        break;
+    }
+    TRACE(EV_REQ_SUB_LEAVE, g->lamport, g->cl[c].rid, g->sub_rank, res);
+    sub_send(g, TAG_SUB_RELEASE, c, res, 0, NULL);
+}
+
+/* hier: the sub-manager let client c in */
+static void sub_grant(Gme *g, int c, const Msg *m) {
+    g->lamport = max2(g->lamport, m->clock) + 1;
+    mt_count(mt.recv, TAG_SUB_GRANT, 1);
+    TRACE(EV_REQ_SUB_ENTER, g->lamport, g->cl[c].rid, g->sub_rank, m->res, m->group);
+    if (g->closing || !on_grant(g, c, m->res, m->timestamp, m->group)) {
+        TRACE(EV_REQ_ABANDON, g->lamport, g->cl[c].rid, m->timestamp, m->res);
+        sub_send(g, TAG_SUB_RELEASE, c, m->res, 0, NULL);
+        return;
+    }
+    if (g->nsh == g->shcap) {
+        g->shcap = g->shcap ? 2 * g->shcap : 8;
+        g->sh = xrealloc(g->sh, 2 * g->shcap * sizeof(int));
+    }
+    g->sh[2 * g->nsh] = c;
+    g->sh[2 * g->nsh + 1] = m->res;
+    ++g->nsh;
+}
+
+/* req.c's hooks: a leader's grant opens res to the node, a leader's
+   request given up frees it. with a sub-manager on the rank, every
+   request of the Req is the sub-manager's, and it never gives up */
+static int rq_granted(void *ctx, int c, int res, int seq, int group) {
+    Gme *g = ctx;
+    if (g->sub) { sub_granted(g->sub, res, group, &g->out); return 1; }
+    int ok = on_grant(g, c, res, seq, group);
+    CoHold *h = g->nch ? co_find(g, c, res, CO_WAIT) : NULL;
+    if (h && h->seq == seq) {
+        if (ok) {
+            co_held(&g->co, res, group);
+            h->st = CO_IN;
+            h->group = group;
+            TRACE(EV_REQ_COHORT_LEAD, g->lamport, g->cl[c].rid, res, group);
+        } else {
+            co_abandon(&g->co, res);
+            co_drop(g, h);
+        }
+    }
+    return ok;
+}
+
+static int rq_gave_up(void *ctx, int c, int seq) {
+    Gme *g = ctx;
+    if (g->sub) return 0;
+    int abandoned = on_gave_up(g, c, seq);
+    for (int i = 0; abandoned && i < g->nch; ++i) {
+        CoHold *h = &g->ch[i];
+        if (h->c != c || h->seq != seq || h->st != CO_WAIT) continue;
+        co_abandon(&g->co, h->res);
+        co_drop(g, h);
+        break;
+    }
+    return abandoned;
+}
+
+/* a node-mate's grant first, then the fast path, then the managers; a
+   request that goes to them leads res's cohort if no one else does.
+   with --hier, everything goes to the node's sub-manager */
+static void rq_request(Gme *g, int c, int res, int seq, const uint64_t *gs) {
+    if (g->cfg->hier) { sub_send(g, TAG_SUB_REQUEST, c, res, seq, gs); return; }
+    if (g->co.on && cohort_join(g, c, res, seq, gs)) return;
+    if (g->fp.on && fast_request(g, c, res, seq, gs)) return;
+    if (g->co.on && co_lead(&g->co, res)) co_add(g, c, res, seq, -1, CO_WAIT);
+    req_request(g->req, c, res, seq, gs, MPI_Wtime(), &g->out);
+}
+
+static void rq_release(Gme *g, int c, int res) {
+    if (g->cfg->hier) { sub_leave(g, c, res); return; }
+    if (g->nfh && fast_release(g, c, res)) return;
+    if (g->nch) {
+        /* a leader keeping its grant for the node may be back in as a joiner */
+        CoHold *h = co_find(g, c, res, CO_JOINED);
+        if (!h) h = co_find(g, c, res, CO_IN);
+        if (h) { cohort_leave(g, h); return; }
+    }
+    req_release(g->req, c, res, MPI_Wtime(), &g->out);
+}
+
+/* leaders still keeping a grant for the node hold the shutdown back:
+   their sessions must not be released under the node-mates inside. so
+   does a sub-manager, until the node's requesters are all done */
+static int co_delegated(const Gme *g) {
+    for (int i = 0; i < g->nch; ++i)
+        if (g->ch[i].st == CO_OUT) return 1;
+    return 0;
+}
+
+static void rq_shutdown(Gme *g) {
+    if (g->closing != 1 || co_delegated(g) || (g->sub && !sub_done(g->sub))) return;
+    g->closing = 2;
+    req_shutdown(g->req, MPI_Wtime(), &g->out);
+}
+
+static void rq_close(Gme *g) {
+    g->closing = 1;
+    if (g->cfg->hier) {
+        while (g->nsh) sub_leave(g, g->sh[0], g->sh[1]);
+        sub_send(g, TAG_SUB_DONE, 0, -1, 0, NULL);
+    }
+    while (g->nfh) fast_release(g, g->fh[0].c, g->fh[0].res);
+    /* the cohort: holders leave, requests not granted yet stop leading */
+    for (int i = g->nch - 1; i >= 0; --i) {
+        if (i >= g->nch) continue;
+        CoHold *h = &g->ch[i];
+        if (h->st == CO_WAIT) { co_abandon(&g->co, h->res); co_drop(g, h); }
+        else if (h->st != CO_OUT) cohort_leave(g, h);
+    }
+    rq_shutdown(g);
+    fo_post(&g->fo, &g->out);
+}
+
+/* all requests seen through: the rank joins termination detection */
+static void rq_check_close(Gme *g) {
+    if (g->closing != 2 || g->closed || req_busy(g->req)) return;
+    TRACE(EV_REQ_EXIT, g->lamport, g->rank);
+    g->closed = 1;
+}
+
+static void rq_on_msg(Gme *g, const Msg *msg, int tag, int src) {
+    int c = msg->rid - g->rank * g->n;
+    if (tag == TAG_APP_CLOSE) rq_close(g);
+    else if (g->mgr && mgr_tag(tag)) mgr_on_msg(g->mgr, msg, g->mgs, tag, src, &g->out);
+    else if (tag == TAG_APP_ACQUIRE) rq_request(g, c, msg->res, msg->timestamp, g->mgs);
+    else if (tag == TAG_APP_RELEASE) rq_release(g, c, msg->res);
+    else if (g->sub && sub_tag(tag)) {
+        sub_on_msg(g->sub, msg, g->mgs, tag, MPI_Wtime(), &g->out);
+        rq_shutdown(g);
+    }
+    else if (tag == TAG_SUB_GRANT) sub_grant(g, c, msg);
+    else if (tag == TAG_COHORT) {
+        g->lamport = max2(g->lamport, msg->clock) + 1;
+        mt_count(mt.recv, tag, 1);
+        cohort_end(g, msg->res);
+        rq_shutdown(g);
+    }
+    else req_on_msg(g->req, msg, tag, src, MPI_Wtime(), &g->out);
+    fo_post(&g->fo, &g->out);
+}
+
+/* requester side closed and the whole job quiet. only asked with the
+   rank's own queue empty, as termination waves need */
+static int rq_finished(Gme *g) {
+    return g->closed && !g->pe.ln && td_poll(&g->td);
+}
+
+/* when the loop must wake up by itself: the next lease end or hedge, or
+   soon if the rank's manager waits for fast-path holders to leave */
+static double rq_deadline(Gme *g) {
+    double t = req_next_timer(g->req);
+    if (g->mgr && mgr_fenced(g->mgr)) {
+        double p = MPI_Wtime() + FP_POLL_SEC;
+        if (t < 0 || p < t) t = p;
+    }
+    return t;
+}
+
+/* leases and hedges that are due, fast-path holders gone, and a metrics
+   snapshot if one is due */
+static void rq_expire(Gme *g) {
+    req_expire(g->req, MPI_Wtime(), &g->out);
+    if (g->mgr) mgr_poll(g->mgr, &g->out);
+    fo_post(&g->fo, &g->out);
+    mt_tick();
+}
+
+/* handle everything pending */
+static void rq_drain(Gme *g) {
+    Msg msg; MPI_Status st;
+    while (pe_next(&g->pe, &msg, g->mgs, &st)) {
+        rq_on_msg(g, &msg, st.MPI_TAG, st.MPI_SOURCE);
+        rq_check_close(g);
+    }
+}
+
+static void *progress_main(void *arg) {
+    Gme *g = arg;
+    if (g->threaded) tr_own();
+    while (!rq_finished(g)) {
+        pe_wait(&g->pe, rq_deadline(g));
+        rq_drain(g);
+        rq_expire(g);
+    }
+    return NULL;
+}
+
+/**************************************************************************
+ * application API
+ **************************************************************************/
+static void app_send(Gme *g, int tag, int rid, int res, int seq, const uint64_t *gs) {
+    Msg m = { seq, g->rank, -1, gs ? g->gw : 0, 0, rid, res, 0 };
+    size_t len = sizeof(Msg);
+    memcpy(g->app_wire, &m, sizeof(Msg));
+    if (gs) {
+        memcpy(g->app_wire + sizeof(Msg), gs, g->gw * sizeof(uint64_t));
+        len += g->gw * sizeof(uint64_t);
+    }
+    MPI_Send(g->app_wire, (int)len, MPI_BYTE, g->rank, tag, MPI_COMM_WORLD);
+}
+
+/* let the protocol move on: inline, run it until something arrives; with
+   a progress thread, sleep until it signals. called with mu held; 0 once
+   the deadline has passed */
+static int app_wait(Gme *g, double deadline) {
+    if (!g->threaded) {
+        if (deadline >= 0 && MPI_Wtime() >= deadline) return 0;
+        pthread_mutex_unlock(&g->mu);
+        /* leases running out wake us too */
+        double until = rq_deadline(g);
+        if (until < 0 || (deadline >= 0 && deadline < until)) until = deadline;
+        if (pe_wait(&g->pe, until)) rq_drain(g);
+        rq_expire(g);
+        pthread_mutex_lock(&g->mu);
+        return 1;
+    }
+    if (deadline < 0) { pthread_cond_wait(&g->cv, &g->mu); return 1; }
+
+    /* deadline is on the MPI_Wtime() clock, the wait on the realtime one */
+    double left = deadline - MPI_Wtime();
+    if (left <= 0) return 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    double frac = ts.tv_nsec * 1e-9 + left;
+    ts.tv_sec += (time_t)floor(frac);
+    ts.tv_nsec = (long)((frac - floor(frac)) * 1e9);
+    return pthread_cond_timedwait(&g->cv, &g->mu, &ts) != ETIMEDOUT;
+}
+
+Gme *gme_open(const Config *cfg, const Coterie *cot, int rank, int nclients, int threaded) {
+    Gme *g = xrealloc(NULL, sizeof(Gme));
+    memset(g, 0, sizeof(*g));
+    g->cfg = cfg; g->cot = cot;
+    g->rank = rank;
+    g->gw = GSET_WORDS(cfg->ngroups);
+    g->threaded = threaded;
+    g->n = nclients;
+
+    g->app_wire = xrealloc(NULL, sizeof(Msg) + g->gw * sizeof(uint64_t));
+    g->mgs = xrealloc(NULL, g->gw * sizeof(uint64_t));
+    g->cl = xrealloc(NULL, nclients * sizeof(Client));
+    memset(g->cl, 0, nclients * sizeof(Client));
+    for (int c = 0; c < nclients; ++c) g->cl[c].rid = rid_of(rank, c, nclients);
+
+    pthread_mutex_init(&g->mu, NULL);
+    pthread_cond_init(&g->cv, NULL);
+    pe_init(&g->pe, g->gw);
+    fo_init(&g->fo);
+    out_init(&g->out);
+    td_init(&g->td);
+    pe_wake_on(&g->pe, &g->td.req);
+    fp_init(&g->fp, cfg->rma, cfg->symmetric ? FP_SLOTS : 0);
+    g->maxq = cot_max_qsize(cot);
+    if (cfg->symmetric) {
+        MgrHooks hk = fp_mgr_hooks(&g->fp);
+        g->mgr = mgr_open(cfg, cot, rank, &g->lamport, cfg->rma ? &hk : NULL);
+        pe_loopback(&g->pe, rank);
+    }
+    co_init(&g->co, cfg->cohort > 0);
+    int nlocal = 0;
+    g->sub_rank = cfg->hier ? node_sub(1, &nlocal) : -1;
+    ReqHooks hk = { rq_granted, rq_gave_up, g };
+    g->req = req_open(cfg, cot, rank, nclients, &g->lamport, &hk);
+    if (g->sub_rank == rank) {
+        /* the node's requests go to the managers as client 0's */
+        g->sub = sub_open(cfg, rank, nlocal, &g->lamport, g->req, 0);
+        pe_loopback(&g->pe, rank);
+    }
+
+    if (threaded && pthread_create(&g->thr, NULL, progress_main, g) != 0) {
+        fprintf(stderr, "[rank %d] cannot start progress thread, running inline\n", rank);
+        g->threaded = 0;
+    }
+    return g;
+}
+
+int gme_rid(const Gme *g, int client) { return g->cl[client].rid; }
+
+/* returns the request's sequence number */
+static int app_request(Gme *g, int client, int res, const uint64_t *gset) {
+    Client *cl = &g->cl[client];
+    int seq = ++cl->app_seq;
+    if (g->threaded) app_send(g, TAG_APP_ACQUIRE, cl->rid, res, seq, gset);
+    else {
+        rq_request(g, client, res, seq, gset);
+        fo_post(&g->fo, &g->out);
+    }
+    return seq;
+}
+
+void gme_request(Gme *g, int client, int res, const uint64_t *gset) { app_request(g, client, res, gset); }
+
+int gme_wait_any(Gme *g, double deadline, int *client, int *res, int *group) {
+    int rc = 0;
+    Ready e;
+    pthread_mutex_lock(&g->mu);
+    while (!rdy_pop(g, &e)) {
+        if (!app_wait(g, deadline) && !rdy_pop(g, &e)) { rc = -1; break; }
+    }
+    pthread_mutex_unlock(&g->mu);
+    if (rc == 0) { *client = e.c; *res = e.res; *group = e.group; }
+    return rc;
+}
+
+int gme_acquire(Gme *g, int client, int res, const uint64_t *gset, double deadline, int *group) {
+    int seq = app_request(g, client, res, gset);
+
+    int rc = 0;
+    pthread_mutex_lock(&g->mu);
+    while (!rdy_take(g, client, seq, group)) {
+        if (!app_wait(g, deadline) && !rdy_take(g, client, seq, group)) { rc = -1; break; }
+    }
+    if (rc != 0) gave_up_add(&g->cl[client], seq);
+    pthread_mutex_unlock(&g->mu);
+    return rc;
+}
+
+void gme_release(Gme *g, int client, int res) {
+    if (g->threaded) app_send(g, TAG_APP_RELEASE, g->cl[client].rid, res, 0, NULL);
+    else {
+        rq_release(g, client, res);
+        fo_post(&g->fo, &g->out);
+    }
+}
+
+void gme_close(Gme *g) {
+    if (g->threaded) {
+        app_send(g, TAG_APP_CLOSE, -1, -1, 0, NULL);
+        pthread_join(g->thr, NULL);
+        tr_own();
+    } else {
+        rq_close(g);
+        rq_check_close(g);
+        progress_main(g);
+    }
+
+    co_free(&g->co);
+    fp_free(&g->fp);
+    td_free(&g->td);
+    pe_free(&g->pe);
+    fo_free(&g->fo);
+    out_free(&g->out);
+    if (g->mgr) mgr_close(g->mgr);
+    if (g->sub) sub_close(g->sub);
+    req_close(g->req);
+    pthread_cond_destroy(&g->cv);
+    pthread_mutex_destroy(&g->mu);
+    for (int c = 0; c < g->n; ++c) free(g->cl[c].gave_up);
+    free(g->app_wire);
+    free(g->mgs);
+    free(g->cl);
+    free(g->rdy);
+    for (int i = 0; i < g->fhcap; ++i) free(g->fh[i].held);
+    free(g->fh);
+    free(g->ch);
+    free(g->sh);
+    free(g);
+}
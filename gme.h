@@ -0,0 +1,105 @@
+#ifndef GME_H
+#define GME_H
+
+/**************************************************************************
+ * gme - group mutual exclusion lock for application code
+ *
+ *   Gme *g = gme_open(&cfg, &cot, rank, 1, 1);
+ *   if (gme_acquire(g, 0, res, gset, -1.0, &group) == 0) {
+ *       ... critical section on res, shared with other holders of `group` ...
+ *       gme_release(g, 0, res);
+ *   }
+ *   gme_close(g);
+ *
+ * a handle hosts nclients logical requesters (clients 0..nclients-1),
+ * each with its own request, quorum and protocol state, multiplexed over
+ * the rank's one progress loop. a client is known to the managers by its
+ * rid (gme_rid), not by the rank. many clients are driven with
+ * gme_request + gme_wait_any; gme_acquire is the blocking form for one.
+ *
+ * every resource (any int) is its own group lock, run by the same
+ * managers; a client may hold and wait on any number of resources at
+ * once. the library does not order them: a caller taking several at a
+ * time should take them in a fixed (e.g. ascending) order.
+ *
+ * threaded: a progress thread owns all protocol traffic (and, through
+ *   tr_own, the trace buffer) of the rank, so CANCELs, stale replies and
+ *   ENTERs are answered while the application sits in its CS, and
+ *   gme_release returns as soon as the release is queued. needs
+ *   MPI_THREAD_MULTIPLE. the application talks to the thread through
+ *   messages to its own rank (TAG_APP_*), which is what wakes the thread
+ *   from its blocking receive.
+ * inline: no thread; the waiting calls and gme_close drive the protocol
+ *   themselves, so nothing is answered between them.
+ *
+ * lease (cfg->lease > 0): a pivot's release keeps its session locked at
+ *   the managers for up to cfg->lease seconds. the next acquire by the
+ *   same client of the same resource, for a set holding the session's
+ *   group, then enters without sending a message. a manager that queues
+ *   a request the session cannot admit sends REVOKE, and the session is
+ *   released for real at once (or at the end of the CS it is in). a
+ *   lease is only released from the protocol loop, so inline it may
+ *   outlive cfg->lease until the next waiting call.
+ *
+ * hedging (cfg->hedge > 0): a request not granted within cfg->hedge
+ *   seconds is also sent, with the same timestamp, to the least loaded
+ *   quorum not asked yet (at most HEDGE_MAX more). the first quorum whose
+ *   members all sent OK is locked and the other managers get NONEED, so
+ *   one slow or stalled manager does not hold the request up.
+ *
+ * fast path (cfg->rma): a request first tries to count itself in at
+ *   every member of the quorum its message would go to (req_quorum)
+ *   with RMA compare-and-swaps on their state
+ *   words (proto.h), and is granted with no message if none of them is
+ *   running the resource through its protocol or held for another group.
+ *   otherwise it goes the message way. managers hold their OKs until the
+ *   fast holders of a resource have left.
+ *
+ * cohort (cfg->cohort): the first request of a node sent to the managers
+ *   for a resource leads it; once granted, later requests on the
+ *   node for that group join through a shared-memory word (proto.h) with
+ *   no message. the leader holds its grant until the last one is out.
+ *
+ * hierarchical (cfg->hier): requests and releases go to the node's
+ *   sub-manager (sub.h) rather than to the managers. it runs on the
+ *   node's lowest requester rank, in the same loop, and asks the managers
+ *   for the whole node through that rank's client 0.
+ *
+ * symmetric (cfg->symmetric): the handle also runs the rank's manager in
+ *   the same loop, and messages between the two never leave the process.
+ *
+ * the job ends by termination detection (proto.h): gme_open and
+ * gme_close are collective over MPI_COMM_WORLD with the dedicated
+ * managers, and gme_close returns once every rank has closed and no
+ * message is left in flight.
+ *
+ * one request at a time per client and resource, and calls from one
+ * application thread.
+ **************************************************************************/
+#include <stdint.h>
+
+#include "config.h"
+#include "coterie.h"
+
+typedef struct Gme Gme;
+
+Gme *gme_open(const Config *cfg, const Coterie *cot, int rank, int nclients, int threaded);
+int  gme_rid(const Gme *g, int client);
+
+/* ask for the CS of res for one of the groups in gset (GSET_WORDS(ngroups)
+   words) without waiting; the grant is reported by gme_wait_any */
+void gme_request(Gme *g, int client, int res, const uint64_t *gset);
+/* next grant: client, resource and the group it got. deadline is an
+   MPI_Wtime() value, < 0 waits forever; -1 if it passed first */
+int  gme_wait_any(Gme *g, double deadline, int *client, int *res, int *group);
+/* gme_request + wait for that request's grant. returns -1 if the deadline
+   passed first: the request stays in flight and is released as soon as
+   it is granted */
+int  gme_acquire(Gme *g, int client, int res, const uint64_t *gset, double deadline, int *group);
+void gme_release(Gme *g, int client, int res);
+
+/* see every request in flight through (granted ones are released at
+   once), wait for the end of the job and free g */
+void gme_close(Gme *g);
+
+#endif
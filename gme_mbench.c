@@ -0,0 +1,323 @@
+/**************************************************************************
+ * gme_mbench - microbenchmark of the manager state machine
+ *
+ *   gme_mbench [--msgs=N] [--reps=R] [gme_mpi options] [SCENARIO...]
+ *
+ * measures how fast one manager (mgr.c) handles its messages, with no
+ * MPI, no network and no I/O. each scenario first records a stream of N
+ * messages from a closed loop: simulated requesters answer the
+ * manager's OK, ENTER, CANCEL and FINISHED at once, the way req.c would
+ * with a single manager, and the stream holds everything they send it.
+ * the stream is then fed to a fresh manager R times, back to back, and
+ * the best pass is reported:
+ *
+ *   ns/msg      wall time of mgr_on_msg per message
+ *   allocs/msg  xrealloc calls per message over the second half of the
+ *               stream, once the manager's buffers have grown
+ *   depth       mean queue length after each insert
+ *   enter/cancel  ENTERs and CANCELs sent per 1000 messages
+ *
+ * scenarios (all by default):
+ *   deep       4096 requesters on one lock, 64 groups: the queue stays
+ *              thousands long and sessions admit a few
+ *   followers  4096 requesters in one group: sessions admit the whole
+ *              queue and the follower set is thousands large
+ *   cancel     256 requesters in groups of their own over 4 locks, whose
+ *              timestamps run out of order and who lock late: OKs are
+ *              cancelled and requeued all the time
+ *   groups     1024 requesters asking for 8 of 4096 groups each: wide
+ *              sets and thousands of per-group indexes
+ *   resources  4096 requesters spread over 1024 locks: resource state
+ *              comes and goes all the time
+ *
+ * gme_mpi options that concern the manager (--admit, --lease) apply to
+ * every scenario; --seed seeds the streams. a scenario's stream only
+ * depends on the options, so numbers from two builds compare directly.
+ **************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "config.h"
+#include "coterie.h"
+#include "gset.h"
+#include "metrics.h"
+#include "mgr.h"
+#include "wire.h"
+
+static long nalloc;         /* xrealloc calls */
+
+void *xrealloc(void *p, size_t sz) {
+    ++nalloc;
+    void *q = realloc(p, sz);
+    if (!q && sz) { fprintf(stderr, "out of memory\n"); abort(); }
+    return q;
+}
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+static uint64_t rng_next(uint64_t *s) {
+    uint64_t z = (*s += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**************************************************************************
+ * scenarios
+ **************************************************************************/
+typedef struct {
+    const char *name;
+    int nreq;               /* requesters */
+    int ngroups, k;         /* groups, groups in a requester's set */
+    int resources;
+    int skew;               /* timestamps up to this far behind the clock */
+    int late;               /* laps of the in-flight FIFO before locking */
+} Scenario;
+
+static const Scenario scenarios[] = {
+    { "deep",      4096,   64, 1,    1,       0, 0 },
+    { "followers", 4096,    1, 1,    1,       0, 0 },
+    { "cancel",     256,  256, 1,    4, 1 << 16, 1 },
+    { "groups",    1024, 4096, 8,    1,       0, 0 },
+    { "resources", 4096,    2, 1, 1024,       0, 0 },
+};
+#define NSCENARIOS ((int)(sizeof(scenarios) / sizeof(scenarios[0])))
+
+/**************************************************************************
+ * stream recording
+ *
+ * requesters make one request at a time. on OK they lock later (a WAKE
+ * queued behind whatever is in flight), so a better request arriving
+ * first draws a CANCEL, answered if they have not locked yet. a pivot
+ * releases right after locking; a follower as soon as it enters. both
+ * ask again at once.
+ **************************************************************************/
+#define TAG_WAKE (-1)       /* requester's own step, never sent */
+
+enum { Q_WAIT, Q_OK, Q_IN };
+typedef struct {
+    int state, ts, res, group;
+    int laps;               /* Q_OK: FIFO laps left before locking */
+} Client;
+
+typedef struct { Msg m; int tag; } Item;
+
+typedef struct {
+    const Scenario *sc;
+    int gw;
+    uint64_t *sets;         /* requester i's set at sets + i * gw */
+    Client *cl;
+    Item *q; int head, n, cap;  /* in flight, FIFO */
+    int clock;
+    uint64_t rng;
+    long enters, cancels;
+} Gen;
+
+static void push(Gen *g, int rid, int tag, int ts, int group) {
+    if (g->n == g->cap) {
+        int cap = g->cap ? 2 * g->cap : 1024;
+        Item *q = xrealloc(NULL, cap * sizeof(Item));
+        for (int i = 0; i < g->n; ++i) q[i] = g->q[(g->head + i) % g->cap];
+        free(g->q);
+        g->q = q; g->head = 0; g->cap = cap;
+    }
+    Msg m = { ts, rid + 1, group, tag == TAG_REQUEST ? g->gw : 0, ++g->clock, rid, g->cl[rid].res, 0 };
+    g->q[(g->head + g->n++) % g->cap] = (Item){ m, tag };
+}
+
+static void request(Gen *g, int rid) {
+    Client *c = &g->cl[rid];
+    int ts = g->clock + 1;
+    if (g->sc->skew) ts -= (int)(rng_next(&g->rng) % (uint64_t)g->sc->skew);
+    c->state = Q_WAIT;
+    c->res = (int)(rng_next(&g->rng) % (uint64_t)g->sc->resources);
+    push(g, rid, TAG_REQUEST, ts, -1);
+}
+
+/* a manager's reply reaches its requester */
+static void react(Gen *g, const Msg *o, int tag) {
+    Client *c = &g->cl[o->rid];
+    switch (tag) {
+        case TAG_OK:
+            c->state = Q_OK;
+            c->ts = o->timestamp;
+            c->group = o->group >= 0 ? o->group : gs_first(g->sets + (size_t)o->rid * g->gw, g->gw);
+            c->laps = g->sc->late;
+            push(g, o->rid, TAG_WAKE, c->ts, c->group);
+            break;
+        case TAG_CANCEL:
+            ++g->cancels;
+            if (c->state != Q_OK) break;
+            c->state = Q_WAIT;
+            push(g, o->rid, TAG_CANCELLED, o->timestamp, -1);
+            break;
+        case TAG_ENTER:
+            ++g->enters;
+            push(g, o->rid, TAG_RELEASE, o->timestamp, -1);
+            request(g, o->rid);
+            break;
+        case TAG_FINISHED:
+            push(g, o->rid, TAG_OVER, o->timestamp, -1);
+            request(g, o->rid);
+            break;
+    }
+}
+
+/* the first n messages the scenario's requesters send the manager */
+static Item *record(Gen *g, const Config *cfg, const Coterie *cot, int n) {
+    Item *s = xrealloc(NULL, (size_t)n * sizeof(Item));
+    int lamport = 0, k = 0;
+    Mgr *m = mgr_open(cfg, cot, 0, &lamport, NULL);
+    Out out; out_init(&out);
+    for (int i = 0; i < g->sc->nreq; ++i) request(g, i);
+
+    while (k < n && g->n) {
+        Item it = g->q[g->head];
+        g->head = (g->head + 1) % g->cap;
+        --g->n;
+        Client *c = &g->cl[it.m.rid];
+        if (it.tag == TAG_WAKE) {
+            if (c->state != Q_OK) continue;
+            if (c->laps-- > 0) { push(g, it.m.rid, TAG_WAKE, c->ts, c->group); continue; }
+            c->state = Q_IN;
+            push(g, it.m.rid, TAG_LOCK, c->ts, c->group);
+            push(g, it.m.rid, TAG_RELEASE, c->ts, -1);
+            continue;
+        }
+        s[k++] = it;
+        mgr_on_msg(m, &it.m, g->sets + (size_t)it.m.rid * g->gw, it.tag, it.m.rank, &out);
+        for (int i = 0; i < out.n; ++i) {
+            Msg o;
+            memcpy(&o, out_bytes(&out, i), sizeof(o));
+            react(g, &o, out.m[i].tag);
+        }
+        out_clear(&out);
+    }
+    out_free(&out);
+    mgr_close(m);
+    if (k < n) fprintf(stderr, "%s: the requesters went quiet after %d messages\n", g->sc->name, k);
+    g->n = k;
+    return s;
+}
+
+/**************************************************************************
+ * measurement
+ **************************************************************************/
+typedef struct { double ns, allocs, depth; } Pass;   /* per message, but depth */
+
+static Pass replay(const Item *s, int n, const uint64_t *sets, int gw, const Config *cfg, const Coterie *cot) {
+    mt_open(NULL, 0, 0, now);
+    Out out;
+    int lamport = 0, half = n / 2;
+    long a0 = 0;
+    double t0 = now();
+    out_init(&out);
+    Mgr *m = mgr_open(cfg, cot, 0, &lamport, NULL);
+    for (int i = 0; i < n; ++i) {
+        if (i == half) a0 = nalloc;
+        mgr_on_msg(m, &s[i].m, sets + (size_t)s[i].m.rid * gw, s[i].tag, s[i].m.rank, &out);
+        out_clear(&out);
+    }
+    double t1 = now();
+    Pass p = { 1e9 * (t1 - t0) / n, (double)(nalloc - a0) / (n - half), 0 };
+    mgr_close(m);
+    out_free(&out);
+
+    int64_t inserts = 0;
+    for (int b = 0; b < MT_BUCKETS; ++b) inserts += mt.qdepth[b];
+    p.depth = inserts ? (double)mt.qdepth_sum / inserts : 0;
+    return p;
+}
+
+static void run(const Scenario *sc, const Config *base, int nmsg, int reps) {
+    Config cfg = *base;
+    cfg.nmgr = 1;
+    cfg.ngroups = sc->ngroups;
+    Coterie cot;
+    if (cot_build(&cot, COT_MAJORITY, 1) != 0) { fprintf(stderr, "cannot build a coterie\n"); exit(EXIT_FAILURE); }
+
+    Gen g;
+    memset(&g, 0, sizeof(g));
+    g.sc = sc;
+    g.gw = GSET_WORDS(sc->ngroups);
+    g.rng = (base->wl.seed * 0x9E3779B97F4A7C15ULL) ^ (uint64_t)(sc - scenarios);
+    g.sets = xrealloc(NULL, (size_t)sc->nreq * g.gw * sizeof(uint64_t));
+    g.cl = xrealloc(NULL, sc->nreq * sizeof(Client));
+    memset(g.cl, 0, sc->nreq * sizeof(Client));
+    for (int i = 0; i < sc->nreq; ++i) {
+        uint64_t *gs = g.sets + (size_t)i * g.gw;
+        gs_zero(gs, g.gw);
+        if (sc->k == 1) { gs_set(gs, i % sc->ngroups); continue; }
+        for (int j = 0; j < sc->k; ) {
+            int x = (int)(rng_next(&g.rng) % (uint64_t)sc->ngroups);
+            if (!gs_test(gs, x)) { gs_set(gs, x); ++j; }
+        }
+    }
+    Item *s = record(&g, &cfg, &cot, nmsg);
+    int n = g.n;
+
+    Pass best = { 0, 0, 0 };
+    for (int r = 0; r < reps && n; ++r) {
+        Pass p = replay(s, n, g.sets, g.gw, &cfg, &cot);
+        if (r == 0 || p.ns < best.ns) best = p;
+    }
+    printf("%-10s %9d %9.1f %10.0f %11.3f %9.1f %7.1f %7.1f\n", sc->name, n, best.ns,
+           best.ns > 0 ? 1e9 / best.ns : 0.0, best.allocs, best.depth,
+           n ? 1e3 * g.enters / n : 0.0, n ? 1e3 * g.cancels / n : 0.0);
+    fflush(stdout);
+
+    free(s);
+    free(g.q);
+    free(g.cl);
+    free(g.sets);
+    cot_free(&cot);
+}
+
+/**************************************************************************
+ * main
+ **************************************************************************/
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [--msgs=N] [--reps=R] [gme_mpi options] [SCENARIO...]\n       scenarios:", prog);
+    for (int i = 0; i < NSCENARIOS; ++i) fprintf(stderr, " %s", scenarios[i].name);
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv) {
+    Config cfg; cfg_defaults(&cfg);
+    int nmsg = 200000, reps = 5;
+    int pick[NSCENARIOS] = { 0 }, npick = 0;
+    char err[512];
+    for (int i = 1; i < argc; ++i) {
+        const char *a = argv[i];
+        if (strncmp(a, "--msgs=", 7) == 0) {
+            if (cfg_parse_int(a + 7, 1, &nmsg) == 0) continue;
+            snprintf(err, sizeof(err), "bad value in %s", a);
+        } else if (strncmp(a, "--reps=", 7) == 0) {
+            if (cfg_parse_int(a + 7, 1, &reps) == 0) continue;
+            snprintf(err, sizeof(err), "bad value in %s", a);
+        } else if (strncmp(a, "--", 2) == 0) {
+            if (cfg_parse_arg(&cfg, a, err, sizeof(err)) == 1) continue;
+        } else {
+            int k = 0;
+            while (k < NSCENARIOS && strcmp(a, scenarios[k].name)) ++k;
+            if (k < NSCENARIOS) { npick += !pick[k]; pick[k] = 1; continue; }
+            snprintf(err, sizeof(err), "unknown scenario %s", a);
+        }
+        fprintf(stderr, "%s\n", err);
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("%-10s %9s %9s %10s %11s %9s %7s %7s\n", "scenario", "msgs", "ns/msg", "msg/s", "allocs/msg",
+           "depth", "enter", "cancel");
+    for (int i = 0; i < NSCENARIOS; ++i)
+        if (!npick || pick[i]) run(&scenarios[i], &cfg, nmsg, reps);
+    cfg_free(&cfg);
+    return EXIT_SUCCESS;
+}
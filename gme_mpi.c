@@ -2,629 +2,375 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
-#include <stdbool.h>
-
-/* colors */
-#define CLR_MGR   "\033[1;33m"
-#define CLR_REQ   "\033[1;36m"
-#define CLR_CS    "\033[1;32m"
-#define CLR_ERR   "\033[1;31m"
-#define CLR_ST    "\033[1;35m"
-#define CLR_RST   "\033[0m"
-
-#define NUM_MANAGERS 3
-#define NUM_GROUPS 2
-#define MAX_QUEUE 128
-#define SIM_SECONDS 5.0
-
-/* message tags */
-enum { TAG_REQUEST, TAG_OK, TAG_LOCK, TAG_ENTER,
-       TAG_RELEASE, TAG_NONEED, TAG_CANCEL,
-       TAG_CANCELLED, TAG_FINISHED, TAG_OVER };
-
-/* message payload */
-typedef struct {
-    int timestamp;
-    int rank;
-    bool gset[NUM_GROUPS];
-    int group;
-} Msg;
-
-/* manager/requester states */
-typedef enum { M_VACANT, M_WAITLOCK, M_LOCKED, M_RELEASING, M_WAITCANCEL } MState;
-typedef enum { R_IDLE, R_WAIT, R_IN, R_OUT } RState;
-
-/* helpers */
-static inline int max2(int a, int b) { return a > b ? a : b; }
-static inline int higher(int ts1, int r1, int ts2, int r2) {
-    if (ts1 < ts2) return 1;
-    if (ts1 > ts2) return 0;
-    return r1 < r2;
-}
-
-/* coterie */
-#define COT_SIZE 3
-#define QSIZE 2
-static const int COT[COT_SIZE][QSIZE] = { {0,1}, {1,2}, {0,2} };
-
-/* queue utilities */
-static int best_idx(Msg *q, int n) {
-    if (n == 0) return -1;
-    int b = 0;
-    for (int i = 1; i < n; ++i)
-        if (higher(q[i].timestamp, q[i].rank, q[b].timestamp, q[b].rank)) b = i;
-    return b;
-}
-static Msg pop_index(Msg *q, int *n, int i) {
-    Msg out = q[i];
-    q[i] = q[*n - 1];
-    --(*n);
-    return out;
-}
-static void insert_pri(Msg *q, int *n, Msg m) {
-    if (*n >= MAX_QUEUE) return;
-    int i = *n - 1;
-    while (i >= 0) {
-        if (higher(q[i].timestamp, q[i].rank, m.timestamp, m.rank)) {
-            q[i + 1] = q[i];
-            --i;
-        } else break;
-    }
-    q[i + 1] = m;
-    ++(*n);
-}
 
-/* small sets */
-static int in_set(int *s, int n, int x) {
-    for (int i = 0; i < n; ++i) if (s[i] == x) return 1;
-    return 0;
-}
-static int remove_set(int *s, int *n, int x) {
-    for (int i = 0; i < *n; ++i) {
-        if (s[i] == x) { s[i] = s[*n - 1]; --(*n); return 1; }
-    }
-    return 0;
-}
+#include "coterie.h"
+#include "gset.h"
+#include "bench.h"
+#include "metrics.h"
+#include "trace.h"
+#include "config.h"
+#include "proto.h"
+#include "gme.h"
+#include "mgr.h"
 
-/* pretty printing of group set */
-static void fmt_gset(char *buf, bool gset[NUM_GROUPS]) {
-    buf[0] = '\0';
-    strcat(buf, "{");
-    for (int i = 0; i < NUM_GROUPS; ++i) {
-        if (gset[i]) {
-            char t[8];
-            snprintf(t, sizeof(t), " g%d", i);
-            strcat(buf, t);
+/**************************************************************************
+ * manager role - a dedicated manager rank
+ **************************************************************************/
+void manager_role(int rank, const Config *cfg, const Coterie *cot) {
+    int lamport = 0;
+    int gw = GSET_WORDS(cfg->ngroups);
+    uint64_t *mgs = xrealloc(NULL, gw * sizeof(uint64_t));  /* payload of current msg */
+
+    Progress pe; pe_init(&pe, gw);
+    Fanout fo; fo_init(&fo);
+    Out out; out_init(&out);
+
+    /* a manager only answers, so it is passive between messages and
+       runs until the job is over; it only wakes by itself to see fast-path
+       holders out of a resource its protocol wants */
+    Term td; td_init(&td);
+    pe_wake_on(&pe, &td.req);
+    Fast fp; fp_init(&fp, cfg->rma, FP_SLOTS);
+    Cohort co; co_init(&co, cfg->cohort > 0);      /* collective; only requesters use it */
+    int nlocal;
+    if (cfg->hier) node_sub(0, &nlocal);
+    MgrHooks hk = fp_mgr_hooks(&fp);
+    Mgr *m = mgr_open(cfg, cot, rank, &lamport, cfg->rma ? &hk : NULL);
+    while (!td_poll(&td)) {
+        pe_wait(&pe, mgr_fenced(m) ? MPI_Wtime() + FP_POLL_SEC : -1.0);
+
+        Msg msg; MPI_Status st;
+        while (pe_next(&pe, &msg, mgs, &st)) {
+            mgr_on_msg(m, &msg, mgs, st.MPI_TAG, st.MPI_SOURCE, &out);
+            fo_post(&fo, &out);
         }
+        mgr_poll(m, &out);
+        fo_post(&fo, &out);
+        mt_tick();
     }
-    strcat(buf, " }");
-}
 
-/* print queue (manager) */
-static void print_queue_int(int mgr, Msg *q, int qn) {
-    printf(CLR_MGR "[mgr %d] queue:", mgr);
-    if (qn == 0) { printf(" <empty>" CLR_RST "\n"); fflush(stdout); return; }
-    for (int i = 0; i < qn; ++i) {
-        printf(" (r%d,ts=%d)", q[i].rank, q[i].timestamp);
-    }
-    printf(CLR_RST "\n");
-    fflush(stdout);
+    co_free(&co);
+    fp_free(&fp);
+    td_free(&td);
+    pe_free(&pe);
+    fo_free(&fo);
+    out_free(&out);
+    mgr_close(m);
+    free(mgs);
 }
 
 /**************************************************************************
- * manager role - high-detail logging
+ * requester role - workload driver on top of the gme lock API
+ *
+ * every logical client of the rank runs the workload on its own: a timer
+ * heap holds each client's next arrival or CS exit, and grants come back
+ * from gme_wait_any while waiting for the earliest timer. the run lasts
+ * wl->duration, or with wl->entries until every client has made that
+ * many entries, or with wl->replay until the file is played through.
  **************************************************************************/
-void manager_role(int rank, MPI_Datatype M) {
-    MState state = M_VACANT;
-    int lamport = 0;
+typedef struct { double t; int c; } Timer;
 
-    int gm = -1;
-    bool gmset[NUM_GROUPS] = {0};
-    int pivot = -1;
-    int pivot_ts = -1;
+static void tm_push(Timer *h, int *n, Timer x) {
+    int i = (*n)++;
+    while (i > 0 && h[(i - 1) / 2].t > x.t) { h[i] = h[(i - 1) / 2]; i = (i - 1) / 2; }
+    h[i] = x;
+}
+static Timer tm_pop(Timer *h, int *n) {
+    Timer top = h[0], x = h[--*n];
+    int i = 0;
+    while (1) {
+        int c = 2 * i + 1;
+        if (c >= *n) break;
+        if (c + 1 < *n && h[c + 1].t < h[c].t) ++c;
+        if (h[c].t >= x.t) break;
+        h[i] = h[c];
+        i = c;
+    }
+    if (*n) h[i] = x;
+    return top;
+}
 
-    Msg queue[MAX_QUEUE];
-    int qn = 0;
+typedef struct {
+    WlState ws;
+    double t_arr, t_enter;
+    uint64_t *gs;           /* group set asked for on every resource */
+    int *res, *group;       /* resources of the CS, ascending, and groups got */
+    int held;               /* ... of which granted so far */
+    int in_cs;
+    int left;               /* fixed workload: CS entries still to make */
+    double cs; int rp_res;  /* replay: the request's CS time and first resource */
+} Virt;
+
+/* replay: client c's next request as a timer; 0 if it has none left */
+static int rp_arrival(Replay *rp, Virt *x, int c, double start, Timer *tm, int *ntm) {
+    double t;
+    if (!rp_next(rp, c, &t, &x->cs, &x->rp_res, x->gs)) return 0;
+    tm_push(tm, ntm, (Timer){ start + t, c });
+    return 1;
+}
 
-    Msg ok_sent; ok_sent.rank = -1; ok_sent.timestamp = -1;
-    int followers[MAX_QUEUE]; int fn = 0;
+void requester_role(int rank, const Config *cfg, const Coterie *cot, Stats *stats) {
+    const Workload *wl = &cfg->wl;
+    int n = cfg->clients, k = wl->hold;
+    int gw = GSET_WORDS(cfg->ngroups);
 
-    printf(CLR_MGR "[mgr %d] starting manager role\n" CLR_RST, rank); fflush(stdout);
+    Gme *g = gme_open(cfg, cot, rank, n, cfg->progress == PROGRESS_THREAD);
     double start = MPI_Wtime();
-
-    while (1) {
-        if (MPI_Wtime() - start >= SIM_SECONDS) {
-            printf(CLR_MGR "[mgr %d] sim time elapsed -> exiting\n" CLR_RST, rank);
-            fflush(stdout);
-            break;
+    double deadline = start + wl->duration;
+
+    Replay *rp = NULL;
+    if (wl->replay[0]) {
+        char err[512];
+        int first = gme_rid(g, 0) - (cfg->symmetric ? 0 : cfg->nmgr) * n;
+        if (!(rp = rp_open(wl->replay, first, n, cfg->ngroups, err, sizeof(err)))) {
+            fprintf(stderr, "[rank %d] %s\n", rank, err);
+            MPI_Abort(MPI_COMM_WORLD, 1);
         }
+    }
+    int fixed = wl->entries || rp;
+
+    Virt *v = xrealloc(NULL, n * sizeof(Virt));
+    uint64_t *gsets = xrealloc(NULL, (size_t)n * gw * sizeof(uint64_t));
+    int *slots = xrealloc(NULL, 2 * (size_t)n * k * sizeof(int));
+    Timer *tm = xrealloc(NULL, n * sizeof(Timer));
+    int ntm = 0;
+    for (int c = 0; c < n; ++c) {
+        wl_start(wl, &v[c].ws, gme_rid(g, c), start);
+        v[c].gs = gsets + (size_t)c * gw;
+        v[c].res = slots + 2 * (size_t)c * k;
+        v[c].group = v[c].res + k;
+        v[c].in_cs = 0;
+        v[c].left = wl->entries;
+    }
 
-        MPI_Status st; int flag = 0;
-        MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &flag, &st);
-        if (!flag) { usleep(3000); continue; }
-
-        Msg msg;
-        MPI_Recv(&msg, 1, M, st.MPI_SOURCE, st.MPI_TAG, MPI_COMM_WORLD, &st);
-        int src = st.MPI_SOURCE;
-        int tag = st.MPI_TAG;
-        lamport = max2(lamport, msg.timestamp) + 1;
-
-        /* detailed receipt log */
-        char gbuf[32]; fmt_gset(gbuf, msg.gset);
-        printf(CLR_MGR "[mgr %d] recv tag=%d from %d (msg.ts=%d, gset=%s) state=%d lam=%d\n" CLR_RST,
-               rank, tag, src, msg.timestamp, gbuf, state, lamport);
-        fflush(stdout);
-
-        switch (tag) {
-
-            case TAG_REQUEST: {
-                /* insert and log queue */
-                insert_pri(queue, &qn, msg);
-                printf(CLR_MGR "[mgr %d] inserted request (r%d,ts=%d) -> queue size=%d\n" CLR_RST,
-                       rank, msg.rank, msg.timestamp, qn);
-                print_queue_int(rank, queue, qn);
-
-                /* vacancy -> send OK to highest priority */
-                if (state == M_VACANT) {
-                    int idx = best_idx(queue, qn);
-                    if (idx >= 0) {
-                        Msg sel = pop_index(queue, &qn, idx);
-                        ok_sent = sel;
-                        Msg ok; ok.timestamp = sel.timestamp; ok.rank = rank;
-                        memcpy(ok.gset, sel.gset, sizeof(ok.gset)); ok.group = -1;
-                        ++lamport;
-                        MPI_Send(&ok, 1, M, sel.rank, TAG_OK, MPI_COMM_WORLD);
-                        printf(CLR_MGR "[mgr %d] send OK -> r%d (ok.ts=%d) lam=%d\n" CLR_RST,
-                               rank, sel.rank, sel.timestamp, lamport);
-                        fflush(stdout);
-                        state = M_WAITLOCK;
-                    }
-                }
-                /* waitlock cancellation check */
-                else if (state == M_WAITLOCK && ok_sent.rank >= 0) {
-                    if (higher(msg.timestamp, msg.rank, ok_sent.timestamp, ok_sent.rank)) {
-                        Msg c; c.timestamp = ok_sent.timestamp; c.rank = rank; c.group = -1;
-                        ++lamport;
-                        MPI_Send(&c, 1, M, ok_sent.rank, TAG_CANCEL, MPI_COMM_WORLD);
-                        printf(CLR_MGR CLR_ERR "[mgr %d] sent CANCEL -> r%d (old.ts=%d) lam=%d\n" CLR_RST,
-                               rank, ok_sent.rank, ok_sent.timestamp, lamport);
-                        fflush(stdout);
-                        state = M_WAITCANCEL;
-                    }
-                }
-
-                /* if locked and allowed, send ENTERs */
-                if (state == M_LOCKED && state != M_RELEASING && state != M_WAITCANCEL) {
-                    int i = 0;
-                    while (i < qn) {
-                        bool compatible = queue[i].gset[gm];
-                        bool outranks_pivot = higher(queue[i].timestamp, queue[i].rank, pivot_ts, pivot);
-                        if (compatible && !outranks_pivot) {
-                            Msg ent; ent.timestamp = queue[i].timestamp; ent.rank = rank;
-                            ent.group = gm; memcpy(ent.gset, gmset, sizeof(gmset));
-                            ++lamport;
-                            MPI_Send(&ent, 1, M, queue[i].rank, TAG_ENTER, MPI_COMM_WORLD);
-                            printf(CLR_MGR "[mgr %d] sent ENTER -> r%d group=%d (ent.ts=%d) lam=%d\n" CLR_RST,
-                                   rank, queue[i].rank, gm, ent.timestamp, lamport);
-                            fflush(stdout);
-
-                            if (!in_set(followers, fn, queue[i].rank)) followers[fn++] = queue[i].rank;
-                            pop_index(queue, &qn, i);
-                            continue;
-                        }
-                        ++i;
-                    }
-                }
-                break;
-            }
-
-            case TAG_LOCK: {
-                /* pivot announces lock */
-                gm = msg.group; memcpy(gmset, msg.gset, sizeof(gmset));
-                pivot = msg.rank; pivot_ts = msg.timestamp;
-                ok_sent.rank = -1;
-                state = M_LOCKED;
-                fn = 0;
-
-                printf(CLR_MGR "[mgr %d] LOCK from r%d group=%d ts=%d state->LOCKED\n" CLR_RST,
-                       rank, pivot, gm, pivot_ts);
-                fflush(stdout);
-                print_queue_int(rank, queue, qn);
-
-                /* send ENTER to queued compatible requests (if allowed) */
-                if (state != M_RELEASING && state != M_WAITCANCEL) {
-                    Msg tmp[MAX_QUEUE]; int tn = 0;
-                    for (int i = 0; i < qn; ++i) {
-                        bool compatible = queue[i].gset[gm];
-                        bool outranks_pivot = higher(queue[i].timestamp, queue[i].rank, pivot_ts, pivot);
-                        if (compatible && !outranks_pivot) {
-                            Msg ent = { queue[i].timestamp, rank, {0}, gm };
-                            memcpy(ent.gset, gmset, sizeof(gmset));
-                            ++lamport;
-                            MPI_Send(&ent, 1, M, queue[i].rank, TAG_ENTER, MPI_COMM_WORLD);
-                            printf(CLR_MGR "[mgr %d] sent ENTER -> r%d group=%d (ent.ts=%d) lam=%d\n" CLR_RST,
-                                   rank, queue[i].rank, gm, ent.timestamp, lamport);
-                            fflush(stdout);
-                            if (!in_set(followers, fn, queue[i].rank)) followers[fn++] = queue[i].rank;
-                        } else {
-                            tmp[tn++] = queue[i];
-                        }
-                    }
-                    qn = tn;
-                    for (int i = 0; i < qn; ++i) queue[i] = tmp[i];
-                    print_queue_int(rank, queue, qn);
-                }
-                break;
-            }
-
-            case TAG_RELEASE: {
-                /* pivot begins releasing */
-                state = M_RELEASING;
-                pivot = src;
-                pivot_ts = msg.timestamp;
-                printf(CLR_MGR "[mgr %d] RELEASE from r%d ts=%d state->RELEASING\n" CLR_RST,
-                       rank, pivot, pivot_ts);
-                fflush(stdout);
-
-                if (fn == 0) {
-                    Msg fin = { pivot_ts, rank, {0}, -1 };
-                    ++lamport;
-                    MPI_Send(&fin, 1, M, pivot, TAG_FINISHED, MPI_COMM_WORLD);
-                    printf(CLR_MGR "[mgr %d] no followers -> FINISHED to r%d (ts=%d) lam=%d\n" CLR_RST,
-                           rank, pivot, pivot_ts, lamport);
-                    fflush(stdout);
-                }
-                break;
-            }
-
-            case TAG_NONEED: {
-                /* follower indicates no need */
-                printf(CLR_MGR "[mgr %d] NONEED from r%d (msg.ts=%d)\n" CLR_RST, rank, src, msg.timestamp);
-                fflush(stdout);
-                remove_set(followers, &fn, src);
-                printf(CLR_MGR "[mgr %d] follower removed -> remaining=%d\n" CLR_RST, rank, fn);
-                fflush(stdout);
-
-                if (state == M_RELEASING && fn == 0 && pivot >= 0) {
-                    Msg fin = { pivot_ts, rank, {0}, -1 };
-                    ++lamport;
-                    MPI_Send(&fin, 1, M, pivot, TAG_FINISHED, MPI_COMM_WORLD);
-                    printf(CLR_MGR "[mgr %d] all followers done -> FINISHED to r%d lam=%d\n" CLR_RST,
-                           rank, pivot, lamport);
-                    fflush(stdout);
-                }
-
-                /* cancellation match */
-                if (state == M_WAITCANCEL && ok_sent.rank == src && ok_sent.timestamp == msg.timestamp) {
-                    ok_sent.rank = -1;
-                    state = M_VACANT;
-                    printf(CLR_MGR "[mgr %d] NONEED matched cancelled ok -> VACANT\n" CLR_RST, rank);
-                    fflush(stdout);
-
-                    int i = best_idx(queue, qn);
-                    if (i >= 0) {
-                        Msg sel = pop_index(queue, &qn, i);
-                        ok_sent = sel;
-                        Msg ok = { sel.timestamp, rank, {0}, -1 };
-                        memcpy(ok.gset, sel.gset, sizeof(ok.gset));
-                        ++lamport;
-                        MPI_Send(&ok, 1, M, sel.rank, TAG_OK, MPI_COMM_WORLD);
-                        printf(CLR_MGR "[mgr %d] send OK -> r%d (after noneed) lam=%d\n" CLR_RST,
-                               rank, sel.rank, lamport);
-                        fflush(stdout);
-                        state = M_WAITLOCK;
-                    }
-                }
-                break;
-            }
-
-            case TAG_CANCELLED: {
-                printf(CLR_MGR "[mgr %d] CANCELLED ack from r%d\n" CLR_RST, rank, src); fflush(stdout);
-                if (state == M_WAITCANCEL && ok_sent.rank == src) {
-                    ok_sent.rank = -1;
-                    state = M_VACANT;
-                    int i = best_idx(queue, qn);
-                    if (i >= 0) {
-                        Msg sel = pop_index(queue, &qn, i);
-                        ok_sent = sel;
-                        Msg ok = { sel.timestamp, rank, {0}, -1 };
-                        memcpy(ok.gset, sel.gset, sizeof(ok.gset));
-                        ++lamport;
-                        MPI_Send(&ok, 1, M, sel.rank, TAG_OK, MPI_COMM_WORLD);
-                        printf(CLR_MGR "[mgr %d] send OK -> r%d (after cancelled) lam=%d\n" CLR_RST,
-                               rank, sel.rank, lamport);
-                        fflush(stdout);
-                        state = M_WAITLOCK;
-                    }
-                }
-                break;
-            }
-
-            case TAG_FINISHED: {
-                /* unexpected for manager but log */
-                printf(CLR_MGR "[mgr %d] unexpected FINISHED from %d (ignored)\n" CLR_RST, rank, src); fflush(stdout);
-                break;
-            }
-
-            case TAG_OVER: {
-                /* pivot completed cycle and informs managers */
-                state = M_VACANT;
-                gm = -1; pivot = -1; pivot_ts = -1; fn = 0; memset(gmset, 0, sizeof(gmset));
-                printf(CLR_MGR "[mgr %d] OVER received -> VACANT\n" CLR_RST, rank); fflush(stdout);
-
-                int i = best_idx(queue, qn);
-                if (i >= 0) {
-                    Msg sel = pop_index(queue, &qn, i);
-                    ok_sent = sel;
-                    Msg ok = { sel.timestamp, rank, {0}, -1 };
-                    memcpy(ok.gset, sel.gset, sizeof(ok.gset));
-                    ++lamport;
-                    MPI_Send(&ok, 1, M, sel.rank, TAG_OK, MPI_COMM_WORLD);
-                    printf(CLR_MGR "[mgr %d] send OK -> r%d (after over) lam=%d\n" CLR_RST,
-                           rank, sel.rank, lamport);
-                    fflush(stdout);
-                    state = M_WAITLOCK;
+    int busy = n;           /* clients with entries left */
+    for (int c = 0; c < n; ++c) {
+        if (!rp) tm_push(tm, &ntm, (Timer){ wl_next_arrival(wl, &v[c].ws, start), c });
+        else if (!rp_arrival(rp, &v[c], c, start, tm, &ntm)) --busy;
+    }
+    while (fixed ? busy > 0 : MPI_Wtime() < deadline) {
+        /* arrivals ask for their first resource; CS ends release them all */
+        while (ntm && tm[0].t <= MPI_Wtime()) {
+            Timer e = tm_pop(tm, &ntm);
+            Virt *x = &v[e.c];
+            if (x->in_cs) {
+                double t_exit = MPI_Wtime();
+                for (int i = k - 1; i >= 0; --i) {
+                    gme_release(g, e.c, x->res[i]);
+                    st_cs(stats, gme_rid(g, e.c), x->res[i], x->group[i], x->t_arr, x->t_enter, t_exit);
                 }
-                break;
+                x->in_cs = 0;
+                if (rp) { if (!rp_arrival(rp, x, e.c, start, tm, &ntm)) --busy; continue; }
+                if (wl->entries && --x->left == 0) { --busy; continue; }
+                tm_push(tm, &ntm, (Timer){ wl_next_arrival(wl, &x->ws, t_exit), e.c });
+            } else {
+                x->t_arr = e.t;
+                /* a replayed request with no set uses the client's home set */
+                int picked = rp ? gs_first(x->gs, gw) >= 0 : wl_pick_gset(wl, &x->ws, x->gs, gw);
+                if (!picked) cfg_home_set(cfg, gme_rid(g, e.c), x->gs);
+                if (rp && x->rp_res >= 0) for (int i = 0; i < k; ++i) x->res[i] = x->rp_res + i;
+                else wl_pick_res(wl, &x->ws, x->res);
+                x->held = 0;
+                gme_request(g, e.c, x->res[0], x->gs);
             }
-
-            default:
-                printf(CLR_ERR "[mgr %d] unknown tag %d from %d\n" CLR_RST, rank, tag, src); fflush(stdout);
-                break;
         }
+
+        if (fixed && !busy) break;
+        double until = ntm ? tm[0].t : -1.0;
+        if (!fixed && (until < 0 || until > deadline)) until = deadline;
+        int c, res, group;
+        if (gme_wait_any(g, until, &c, &res, &group) != 0) continue;
+
+        /* resources are taken one at a time in ascending order, so two
+           clients never wait on each other's */
+        Virt *x = &v[c];
+        x->group[x->held++] = group;
+        if (x->held < k) { gme_request(g, c, x->res[x->held], x->gs); continue; }
+
+        /* the CS is the application's; the protocol keeps running meanwhile */
+        x->t_enter = MPI_Wtime();
+        x->in_cs = 1;
+        tm_push(tm, &ntm, (Timer){ x->t_enter + (rp ? x->cs : wl_cs_time(wl, &x->ws)), c });
     }
 
-    printf(CLR_MGR "[mgr %d] exiting manager\n" CLR_RST, rank); fflush(stdout);
+    gme_close(g);
+    rp_close(rp);
+    free(v);
+    free(gsets);
+    free(slots);
+    free(tm);
 }
 
 /**************************************************************************
- * requester role - high-detail logs
+ * benchmark and metrics collectives
  **************************************************************************/
-void requester_role(int rank, MPI_Datatype M) {
-    RState state = R_IDLE;
-    int lamport = 0;
-    int my_ts = 0;
-
-    bool gset[NUM_GROUPS] = {0};
-    if (rank == NUM_MANAGERS) gset[0] = true;
-    else if (rank == NUM_MANAGERS + 1) { gset[0] = true; gset[1] = true; }
-    else gset[1] = true;
-
-    int quorum[QSIZE]; int qn = 0;
-    int ok_count = 0; Msg ok_list[MAX_QUEUE]; int ok_ln = 0;
-    int finished_count = 0;
-
-    int mask = 0;
-    for (int i = 0; i < NUM_GROUPS; ++i) if (gset[i]) mask |= (1 << i);
-
-    printf(CLR_REQ "[req %d] starting requester role gset=", rank);
-    for (int i = 0; i < NUM_GROUPS; ++i) if (gset[i]) printf(" g%d", i);
-    printf(CLR_RST "\n"); fflush(stdout);
-
-    double start = MPI_Wtime();
-
-    while (1) {
-        if (MPI_Wtime() - start >= SIM_SECONDS) {
-            printf(CLR_REQ "[req %d] sim time elapsed -> exiting\n" CLR_RST, rank);
-            fflush(stdout);
-            break;
-        }
-
-        if (state == R_IDLE) {
-            sleep(1);
-            my_ts = ++lamport;
-            ok_count = 0; ok_ln = 0; finished_count = 0;
-
-            /* choose deterministic quorum */
-            int chosen = (rank + mask) % COT_SIZE;
-            qn = QSIZE;
-            for (int i = 0; i < qn; ++i) quorum[i] = COT[chosen][i];
-
-            Msg req; req.timestamp = my_ts; req.rank = rank; memcpy(req.gset, gset, sizeof(gset)); req.group = -1;
-
-            printf(CLR_REQ "[req %d] state idle->wait request# ts=%d chosen_quorum=%d members={", rank, my_ts, chosen);
-            for (int i = 0; i < qn; ++i) printf(" %d", quorum[i]);
-            printf(" }\n" CLR_RST); fflush(stdout);
-
-            for (int i = 0; i < qn; ++i) {
-                ++lamport;
-                req.timestamp = my_ts; /* message contains request timestamp */
-                MPI_Send(&req, 1, M, quorum[i], TAG_REQUEST, MPI_COMM_WORLD);
-                printf(CLR_REQ "[req %d] sent REQUEST(ts=%d) -> mgr %d lam=%d\n" CLR_RST,
-                       rank, my_ts, quorum[i], lamport);
-                fflush(stdout);
+#define CLOCK_PINGS 8
+
+/* estimate every rank's offset to rank 0's clock */
+static double clock_offset(MPI_Comm comm) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    double off = 0;
+    if (rank == 0) {
+        for (int r = 1; r < size; ++r)
+            for (int k = 0; k < CLOCK_PINGS; ++k) {
+                MPI_Recv(NULL, 0, MPI_BYTE, r, 0, comm, MPI_STATUS_IGNORE);
+                double t0 = MPI_Wtime();
+                MPI_Send(&t0, 1, MPI_DOUBLE, r, 0, comm);
             }
-            state = R_WAIT;
+    } else {
+        double best_rtt = 1e30;
+        for (int k = 0; k < CLOCK_PINGS; ++k) {
+            double t1 = MPI_Wtime(), t0;
+            MPI_Send(NULL, 0, MPI_BYTE, 0, 0, comm);
+            MPI_Recv(&t0, 1, MPI_DOUBLE, 0, 0, comm, MPI_STATUS_IGNORE);
+            double t2 = MPI_Wtime();
+            if (t2 - t1 < best_rtt) { best_rtt = t2 - t1; off = t0 - (t1 + t2) / 2; }
         }
+    }
+    return off;
+}
 
-        MPI_Status st; int flag = 0;
-        MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &flag, &st);
-        if (!flag) { usleep(3000); continue; }
-
-        Msg msg;
-        MPI_Recv(&msg, 1, M, st.MPI_SOURCE, st.MPI_TAG, MPI_COMM_WORLD, &st);
-        int src = st.MPI_SOURCE;
-        int tag = st.MPI_TAG;
-        lamport = max2(lamport, msg.timestamp) + 1;
-
-        char gbuf[32]; fmt_gset(gbuf, msg.gset);
-        printf(CLR_REQ "[req %d] recv tag=%d from %d (msg.ts=%d gset=%s) state=%d lam=%d\n" CLR_RST,
-               rank, tag, src, msg.timestamp, gbuf, state, lamport);
-        fflush(stdout);
-
-        if (state == R_WAIT) {
-            /* ignore old replies */
-            if (msg.timestamp != my_ts && (tag == TAG_OK || tag == TAG_ENTER || tag == TAG_CANCEL || tag == TAG_FINISHED)) {
-                printf(CLR_REQ "[req %d] ignoring old reply tag=%d from %d (msg.ts=%d != my_ts=%d)\n" CLR_RST,
-                       rank, tag, src, msg.timestamp, my_ts);
-                fflush(stdout);
-                continue;
-            }
-
-            if (tag == TAG_OK) {
-                ok_list[ok_ln++] = msg;
-                ++ok_count;
-                printf(CLR_REQ "[req %d] OK from mgr %d (ok.ts=%d) (%d/%d)\n" CLR_RST,
-                       rank, src, msg.timestamp, ok_count, qn);
-                fflush(stdout);
-
-                if (ok_count == qn) {
-                    /* decide group (paper: arbitrary) */
-                    int chosen_group = -1;
-                    for (int g = 0; g < NUM_GROUPS; ++g) if (gset[g]) { chosen_group = g; break; }
-                    if (chosen_group < 0) chosen_group = 0;
-
-                    Msg lock; lock.timestamp = my_ts; lock.rank = rank; lock.group = chosen_group;
-                    memcpy(lock.gset, gset, sizeof(gset));
-                    ++lamport;
-                    for (int i = 0; i < qn; ++i) {
-                        MPI_Send(&lock, 1, M, quorum[i], TAG_LOCK, MPI_COMM_WORLD);
-                        printf(CLR_REQ "[req %d] sent LOCK(group=%d,ts=%d) -> mgr %d lam=%d\n" CLR_RST,
-                               rank, chosen_group, my_ts, quorum[i], lamport);
-                        fflush(stdout);
-                    }
-
-                    printf(CLR_REQ "[req %d] pivot entering CS group=%d ts=%d\n" CLR_RST, rank, chosen_group, my_ts);
-                    fflush(stdout);
-
-                    state = R_IN;
-                    printf(CLR_CS "[req %d] in-crit-section (pivot) start\n" CLR_RST, rank); fflush(stdout);
-                    sleep(2);
-                    printf(CLR_CS "[req %d] in-crit-section (pivot) end\n" CLR_RST, rank); fflush(stdout);
-
-                    /* two-phase release */
-                    Msg rel; rel.timestamp = my_ts; rel.rank = rank; rel.group = chosen_group;
-                    ++lamport;
-                    for (int i = 0; i < qn; ++i) {
-                        MPI_Send(&rel, 1, M, quorum[i], TAG_RELEASE, MPI_COMM_WORLD);
-                        printf(CLR_REQ "[req %d] sent RELEASE(ts=%d) -> mgr %d lam=%d\n" CLR_RST,
-                               rank, my_ts, quorum[i], lamport);
-                        fflush(stdout);
-                    }
-                    state = R_OUT;
-                    finished_count = 0;
-                }
-            }
-
-            else if (tag == TAG_ENTER) {
-                int g = msg.group;
-                int enter_ts = msg.timestamp;
-                printf(CLR_REQ "[req %d] received ENTER from mgr %d grant group=%d (ent.ts=%d)\n" CLR_RST,
-                       rank, src, g, enter_ts);
-                fflush(stdout);
-
-                /* notify all quorum members with NONEED using enter_ts */
-                Msg nd; nd.timestamp = enter_ts; nd.rank = rank; nd.group = g;
-                memcpy(nd.gset, gset, sizeof(gset));
-                ++lamport;
-                for (int i = 0; i < qn; ++i) {
-                    MPI_Send(&nd, 1, M, quorum[i], TAG_NONEED, MPI_COMM_WORLD);
-                    printf(CLR_REQ "[req %d] sent NONEED(ts=%d) -> mgr %d lam=%d\n" CLR_RST,
-                           rank, nd.timestamp, quorum[i], lamport);
-                    fflush(stdout);
-                }
-
-                /* follower enters CS immediately */
-                state = R_IN;
-                printf(CLR_CS "[req %d] in-crit-section (follower) start group=%d\n" CLR_RST, rank, g);
-                fflush(stdout);
-                sleep(2);
-                printf(CLR_CS "[req %d] in-crit-section (follower) end group=%d\n" CLR_RST, rank, g);
-                fflush(stdout);
-
-                /* send NONEED again on exit */
-                ++lamport;
-                for (int i = 0; i < qn; ++i) {
-                    MPI_Send(&nd, 1, M, quorum[i], TAG_NONEED, MPI_COMM_WORLD);
-                    printf(CLR_REQ "[req %d] sent NONEED (exit ts=%d) -> mgr %d lam=%d\n" CLR_RST,
-                           rank, nd.timestamp, quorum[i], lamport);
-                    fflush(stdout);
-                }
-
-                state = R_IDLE;
-            }
+/* gather the records at rank 0 on its clock and write the report there */
+static void report(const Stats *s, const Workload *w, const char *meta, const char *out_path,
+                   MPI_Comm comm) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    /* shift local times onto rank 0's clock before shipping */
+    CsRec *mine = malloc((s->n ? s->n : 1) * sizeof(CsRec));
+    for (int i = 0; i < s->n; ++i) {
+        mine[i] = s->rec[i];
+        mine[i].t_arr += s->clock_off;
+        mine[i].t_enter += s->clock_off;
+        mine[i].t_exit += s->clock_off;
+    }
 
-            else if (tag == TAG_CANCEL) {
-                printf(CLR_ERR "[req %d] received CANCEL from mgr %d -> sending CANCELLED and retry\n" CLR_RST,
-                       rank, src);
-                fflush(stdout);
-
-                Msg cancelled; cancelled.timestamp = my_ts; cancelled.rank = rank; cancelled.group = -1;
-                ++lamport;
-                MPI_Send(&cancelled, 1, M, src, TAG_CANCELLED, MPI_COMM_WORLD);
-                printf(CLR_REQ "[req %d] sent CANCELLED -> mgr %d lam=%d\n" CLR_RST,
-                       rank, src, lamport);
-                fflush(stdout);
-
-                /* retry later with new timestamp */
-                state = R_IDLE;
-                sleep(1);
-            }
-        }
+    long sent = 0, local = 0;
+    MPI_Reduce(&s->sent, &sent, 1, MPI_LONG, MPI_SUM, 0, comm);
+    MPI_Reduce(&s->local, &local, 1, MPI_LONG, MPI_SUM, 0, comm);
+
+    int nbytes = s->n * (int)sizeof(CsRec);
+    int *counts = NULL, *displs = NULL;
+    CsRec *all = NULL;
+    int total = 0;
+    if (rank == 0) {
+        counts = malloc(size * sizeof(int));
+        displs = malloc(size * sizeof(int));
+    }
+    MPI_Gather(&nbytes, 1, MPI_INT, counts, 1, MPI_INT, 0, comm);
+    if (rank == 0) {
+        for (int r = 0; r < size; ++r) { displs[r] = total; total += counts[r]; }
+        all = malloc(total ? total : 1);
+    }
+    MPI_Gatherv(mine, nbytes, MPI_BYTE, all, counts, displs, MPI_BYTE, 0, comm);
+    free(mine);
+    if (rank == 0) bench_write(all, total / (int)sizeof(CsRec), sent, local, w, meta, out_path);
+    free(all); free(counts); free(displs);
+}
 
-        else if (state == R_OUT) {
-            if (tag == TAG_FINISHED && msg.timestamp == my_ts) {
-                ++finished_count;
-                printf(CLR_REQ "[req %d] received FINISHED from mgr %d (%d/%d)\n" CLR_RST,
-                       rank, src, finished_count, qn);
-                fflush(stdout);
-
-                if (finished_count == qn) {
-                    Msg over; over.timestamp = my_ts; over.rank = rank; over.group = -1;
-                    ++lamport;
-                    for (int i = 0; i < qn; ++i) {
-                        MPI_Send(&over, 1, M, quorum[i], TAG_OVER, MPI_COMM_WORLD);
-                        printf(CLR_REQ "[req %d] sent OVER(ts=%d) -> mgr %d lam=%d\n" CLR_RST,
-                               rank, my_ts, quorum[i], lamport);
-                        fflush(stdout);
-                    }
-                    state = R_IDLE;
-                }
-            } else {
-                printf(CLR_REQ "[req %d] ignoring tag=%d from %d in OUT state\n" CLR_RST, rank, tag, src); fflush(stdout);
-            }
-        } /* end R_OUT handling */
-    } /* end loop */
+/* sum every rank's metrics at rank 0 and write them there */
+static void metrics_report(const Config *cfg, MPI_Comm comm) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    Metrics all;
+    double mine = mt_elapsed(), elapsed = 0;
+    MPI_Reduce(&mt, &all, MT_WORDS, MPI_INT64_T, MPI_SUM, 0, comm);
+    MPI_Reduce(&mine, &elapsed, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+    if (rank == 0)
+        mt_write(&all, size, elapsed, strcmp(cfg->metrics, "-") == 0 ? NULL : cfg->metrics, cfg->metrics_prom);
 }
 
 /**************************************************************************
  * main
  **************************************************************************/
 int main(int argc, char **argv) {
-    MPI_Init(&argc, &argv);
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
 
     int rank, world;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &world);
 
-    if (world <= NUM_MANAGERS) {
-        if (rank == 0) fprintf(stderr, "need at least %d managers + 1 requester\n", NUM_MANAGERS);
+    Config cfg; cfg_defaults(&cfg);
+    char err[512];
+    for (int i = 1; i < argc; ++i) {
+        if (cfg_parse_arg(&cfg, argv[i], err, sizeof(err)) == 1) continue;
+        if (rank == 0) { fprintf(stderr, "%s\n", err); cfg_usage(stderr, argv[0]); }
         MPI_Finalize();
         return EXIT_FAILURE;
     }
+    if (cfg.symmetric) cfg.nmgr = world;
+    if (cfg_check(&cfg, world, err, sizeof(err)) != 0) {
+        if (rank == 0) fprintf(stderr, "%s\n", err);
+        MPI_Finalize();
+        return EXIT_FAILURE;
+    }
+
+    /* a requester's progress thread shares MPI with the application thread */
+    if (cfg.progress == PROGRESS_THREAD && provided < MPI_THREAD_MULTIPLE) {
+        if (rank == 0) fprintf(stderr, "MPI lacks MPI_THREAD_MULTIPLE, using --progress=inline\n");
+        cfg.progress = PROGRESS_INLINE;
+    }
+
+    /* every rank builds the same coterie deterministically */
+    Coterie cot;
+    if (cot_build(&cot, cfg.coterie, cfg.nmgr) != 0 || !cot_check(&cot)) {
+        if (rank == 0) fprintf(stderr, "cannot build %s coterie over %d managers\n",
+                               cot_kind_name(cfg.coterie), cfg.nmgr);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    /* protocol events go to per-rank trace files; benchmark runs default to none */
+    if (cfg.trace_level < 0) cfg.trace_level = cfg.bench ? 0 : 1;
+    if (tr_open(cfg.trace_prefix, rank, cfg.trace_level, cfg.trace_buf, MPI_Wtime) != 0)
+        fprintf(stderr, "[rank %d] cannot write %s.%d.bin, tracing off\n", rank, cfg.trace_prefix, rank);
+    if (rank == 0 && cfg.trace_level > 0) {
+        printf(CLR_ST "[main] %s coterie: %d quorums over %d managers, max size %d\n" CLR_RST,
+               cot_kind_name(cfg.coterie), cot.nq, cot.nmgr, cot_max_qsize(&cot));
+        printf(CLR_ST "[main] trace level %d -> %s.<rank>.bin (decode with gme_trace)\n" CLR_RST,
+               cfg.trace_level, cfg.trace_prefix);
+        fflush(stdout);
+    }
+    mt_open(cfg.metrics, rank, cfg.metrics_every, MPI_Wtime);
+
+    /* bench traffic runs on its own communicator so it never meets protocol messages */
+    Stats stats; st_init(&stats);
+    MPI_Comm bcomm = MPI_COMM_NULL;
+    if (cfg.bench) {
+        MPI_Comm_dup(MPI_COMM_WORLD, &bcomm);
+        stats.clock_off = clock_offset(bcomm);
+        MPI_Barrier(bcomm);
+    }
+
+    /* symmetric: the requester's loop also runs this rank's manager */
+    if (cfg.symmetric) requester_role(rank, &cfg, &cot, &stats);
+    else if (rank < cfg.nmgr) manager_role(rank, &cfg, &cot);
+    else requester_role(rank, &cfg, &cot, &stats);
+    tr_close();
+    mt_close();
+
+    if (cfg.bench) {
+        char meta[320];
+        stats.sent = n_sent;
+        stats.local = n_local;
+        snprintf(meta, sizeof(meta),
+                 "\"ranks\": %d, \"managers\": %d, \"requesters\": %d, \"clients\": %d, "
+                 "\"symmetric\": %s, \"coterie\": \"%s\", \"groups\": %d",
+                 world, cfg.nmgr, cfg.symmetric ? world : world - cfg.nmgr, cfg.clients,
+                 cfg.symmetric ? "true" : "false", cot_kind_name(cfg.coterie), cfg.ngroups);
+        report(&stats, &cfg.wl, meta, cfg.out[0] ? cfg.out : NULL, bcomm);
+        MPI_Comm_free(&bcomm);
+    }
+    if (cfg.metrics[0]) metrics_report(&cfg, MPI_COMM_WORLD);
 
-    /* create MPI type for Msg */
-    MPI_Datatype MT;
-    int bl[4] = {1,1,NUM_GROUPS,1};
-    MPI_Aint disp[4];
-    MPI_Datatype ty[4] = {MPI_INT, MPI_INT, MPI_C_BOOL, MPI_INT};
-    Msg tmp;
-    MPI_Aint base;
-    MPI_Get_address(&tmp, &base);
-    MPI_Get_address(&tmp.timestamp, &disp[0]);
-    MPI_Get_address(&tmp.rank, &disp[1]);
-    MPI_Get_address(&tmp.gset[0], &disp[2]);
-    MPI_Get_address(&tmp.group, &disp[3]);
-    for (int i = 0; i < 4; ++i) disp[i] = MPI_Aint_diff(disp[i], base);
-
-    MPI_Type_create_struct(4, bl, disp, ty, &MT);
-    MPI_Type_commit(&MT);
-
-    if (rank < NUM_MANAGERS) manager_role(rank, MT);
-    else requester_role(rank, MT);
-
-    MPI_Type_free(&MT);
+    st_free(&stats);
+    cfg_free(&cfg);
+    cot_free(&cot);
     MPI_Finalize();
     return 0;
 }
@@ -0,0 +1,588 @@
+/**************************************************************************
+ * gme_sim - discrete-event simulator of the protocol
+ *
+ *   gme_sim --ranks=N [--latency=SPEC] [--service=S] [gme_mpi options]
+ *
+ * runs all N ranks of a job in one process, on virtual time: the manager
+ * and requester state machines of gme_mpi (mgr.c, req.c), driven by one
+ * event queue instead of MPI. every requester runs the benchmark
+ * workload, and the run ends with the same JSON report as gme_mpi
+ * --bench, so a protocol change can be checked for safety and
+ * throughput at scales no cluster at hand would give.
+ *
+ * network: each message takes a latency drawn from SPEC (seconds)
+ *   fixed:D            always D
+ *   uniform:LO:HI      uniform in [LO, HI]
+ *   exp:MIN:MEAN       MIN plus an exponential tail of mean MEAN
+ *   lognormal:MED:SIG  lognormal with median MED and shape SIG
+ * channels stay FIFO per (sender, receiver) as MPI's are; messages a
+ * rank sends itself (symmetric) take no time.
+ *
+ * ranks: handling a protocol message keeps a rank busy --service
+ * seconds, with later messages waiting in FIFO order; its sends leave
+ * when it is done. application steps (arrivals, grants, exits) are free.
+ *
+ * --metrics sums the counters of all ranks, on virtual time; snapshots
+ * go to FILE.0.
+ *
+ * the run is deterministic for a given command line. at --duration (or
+ * with --entries or --replay, once a rank's clients are all done) the
+ * requesters shut down and the queue is run dry; sessions still busy or
+ * resources still active at a manager afterwards are reported as stuck.
+ **************************************************************************/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+#include "config.h"
+#include "coterie.h"
+#include "gset.h"
+#include "imap.h"
+#include "metrics.h"
+#include "mgr.h"
+#include "req.h"
+#include "trace.h"
+#include "wire.h"
+
+void *xrealloc(void *p, size_t sz) {
+    void *q = realloc(p, sz);
+    if (!q && sz) { fprintf(stderr, "out of memory\n"); abort(); }
+    return q;
+}
+
+/**************************************************************************
+ * options
+ **************************************************************************/
+typedef enum { LAT_FIXED, LAT_UNIFORM, LAT_EXP, LAT_LOGNORMAL } LatKind;
+
+typedef struct {
+    int ranks;
+    LatKind lat;
+    double la, lb;          /* the latency distribution's two parameters */
+    char lat_spec[64];
+    double service;         /* seconds a rank spends on one message */
+} SimOpt;
+
+static int parse_latency(SimOpt *o, const char *s) {
+    static const char *names[] = { "fixed:", "uniform:", "exp:", "lognormal:" };
+    for (int k = 0; k < 4; ++k) {
+        size_t n = strlen(names[k]);
+        if (strncmp(s, names[k], n) != 0) continue;
+        char *end;
+        o->la = strtod(s + n, &end);
+        if (end == s + n || o->la < 0) return -1;
+        o->lb = 0;
+        if (k != LAT_FIXED) {
+            if (*end != ':') return -1;
+            const char *p = end + 1;
+            o->lb = strtod(p, &end);
+            if (end == p || o->lb < 0) return -1;
+            if (k == LAT_UNIFORM && o->lb < o->la) return -1;
+        }
+        if (*end || strlen(s) >= sizeof(o->lat_spec)) return -1;
+        o->lat = (LatKind)k;
+        strcpy(o->lat_spec, s);
+        return 0;
+    }
+    return -1;
+}
+
+/* 1 consumed, 0 not ours, -1 bad value */
+static int sim_parse_arg(SimOpt *o, const char *a) {
+    if (strncmp(a, "--ranks=", 8) == 0) return cfg_parse_int(a + 8, 1, &o->ranks) ? -1 : 1;
+    if (strncmp(a, "--latency=", 10) == 0) return parse_latency(o, a + 10) ? -1 : 1;
+    if (strncmp(a, "--service=", 10) == 0) {
+        char *end;
+        o->service = strtod(a + 10, &end);
+        return end == a + 10 || *end || o->service < 0 ? -1 : 1;
+    }
+    return 0;
+}
+
+/**************************************************************************
+ * event queue - binary heap on (time, insertion order)
+ **************************************************************************/
+enum { SIM_MSG, SIM_RUN, SIM_TIMER, SIM_ARRIVE, SIM_GRANT, SIM_EXIT, SIM_END };
+
+typedef struct {
+    double t;
+    uint64_t seq;
+    int kind, node;
+    int a, b, c;            /* SIM_MSG: slot; SIM_GRANT: client, res, group;
+                               SIM_ARRIVE / SIM_EXIT: client */
+} Event;
+
+typedef struct {
+    Event *h; int n, cap;
+    uint64_t seq;
+} EvQueue;
+
+static inline int ev_before(const Event *x, const Event *y) {
+    return x->t < y->t || (x->t == y->t && x->seq < y->seq);
+}
+
+static void eq_push(EvQueue *q, Event e) {
+    if (q->n == q->cap) {
+        q->cap = q->cap ? 2 * q->cap : 1024;
+        q->h = xrealloc(q->h, q->cap * sizeof(Event));
+    }
+    e.seq = q->seq++;
+    int i = q->n++;
+    while (i > 0 && ev_before(&e, &q->h[(i - 1) / 2])) { q->h[i] = q->h[(i - 1) / 2]; i = (i - 1) / 2; }
+    q->h[i] = e;
+}
+
+static Event eq_pop(EvQueue *q) {
+    Event top = q->h[0], x = q->h[--q->n];
+    int i = 0;
+    while (1) {
+        int c = 2 * i + 1;
+        if (c >= q->n) break;
+        if (c + 1 < q->n && ev_before(&q->h[c + 1], &q->h[c])) ++c;
+        if (!ev_before(&q->h[c], &x)) break;
+        q->h[i] = q->h[c];
+        i = c;
+    }
+    if (q->n) q->h[i] = x;
+    return top;
+}
+
+/**************************************************************************
+ * simulated job
+ **************************************************************************/
+/* one logical requester's workload, as in gme_mpi's requester_role */
+typedef struct {
+    WlState ws;
+    double t_arr, t_enter;
+    uint64_t *gs;
+    int *res, *group;
+    int held, seq;
+    int left;               /* fixed workload: CS entries still to make */
+    double due, cs; int rp_res; /* replay: the request's arrival, CS time, resource */
+} Virt;
+
+typedef struct {
+    Mgr *mgr;
+    Req *req;
+    int lamport;
+    double free_at;         /* busy with a message until then */
+    int running;            /* a SIM_RUN is pending */
+    int *inbox; int ihead, in, icap;    /* slots waiting for the rank */
+    double timer_at;        /* earliest SIM_TIMER pending, -1 none */
+    Virt *v;                /* its clients, when a requester */
+    int busy;               /* ... with entries left (fixed workload) */
+} Node;
+
+typedef struct {
+    const Config *cfg;
+    const SimOpt *opt;
+    int gw, n;              /* gset words, clients per requester */
+    Node *nodes; int nnodes;
+    EvQueue q;
+    double now;
+    int ended;
+
+    /* messages in flight: header + gw words per slot */
+    unsigned char *mbuf; size_t slot;
+    int *msrc, *mtag;
+    int nslot, *mfree, nfree;
+
+    /* FIFO channels: last delivery time per (src, dst) */
+    IMap chan; double *last; int nchan, lcap;
+
+    uint64_t rng;
+    Replay *rp;             /* --replay, over all clients of all requesters */
+    Out out;
+    uint64_t *mgs;
+    long sent, local, events;
+    Stats stats;
+} Sim;
+
+static Sim *sim_clock_of;
+static double sim_clock(void) { return sim_clock_of->now; }
+
+/* xorshift64* */
+static uint64_t sim_rand(Sim *s) {
+    uint64_t x = s->rng;
+    x ^= x >> 12; x ^= x << 25; x ^= x >> 27;
+    s->rng = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+static double sim_uniform(Sim *s) { return (sim_rand(s) >> 11) * (1.0 / 9007199254740992.0); }
+
+static double sim_latency(Sim *s) {
+    const SimOpt *o = s->opt;
+    switch (o->lat) {
+        case LAT_FIXED:   return o->la;
+        case LAT_UNIFORM: return o->la + (o->lb - o->la) * sim_uniform(s);
+        case LAT_EXP:     return o->la - o->lb * log(1.0 - sim_uniform(s));
+        case LAT_LOGNORMAL: {
+            /* Box-Muller; u1 in (0, 1] keeps the log finite */
+            double u1 = 1.0 - sim_uniform(s), u2 = sim_uniform(s);
+            double z = sqrt(-2.0 * log(u1)) * cos(2 * M_PI * u2);
+            return o->la * exp(o->lb * z);
+        }
+    }
+    return o->la;
+}
+
+static int slot_get(Sim *s) {
+    if (s->nfree) return s->mfree[--s->nfree];
+    int i = s->nslot++;
+    s->mbuf = xrealloc(s->mbuf, s->nslot * s->slot);
+    s->msrc = xrealloc(s->msrc, s->nslot * sizeof(int));
+    s->mtag = xrealloc(s->mtag, s->nslot * sizeof(int));
+    s->mfree = xrealloc(s->mfree, s->nslot * sizeof(int));
+    return i;
+}
+
+/* deliver what the step left in s->out, leaving src at time t */
+static void sim_flush(Sim *s, int src, double t) {
+    Out *o = &s->out;
+    for (int i = 0; i < o->n; ++i) {
+        const OutMsg *e = &o->m[i];
+        double at = t;
+        if (e->dst == src) ++s->local;
+        else {
+            ++s->sent;
+            at += sim_latency(s);
+            /* FIFO: never overtake an earlier message on the channel */
+            uint64_t key = (uint64_t)(uint32_t)src << 32 | (uint32_t)e->dst;
+            int c = im_get(&s->chan, key);
+            if (c < 0) {
+                if (s->nchan == s->lcap) {
+                    s->lcap = s->lcap ? 2 * s->lcap : 1024;
+                    s->last = xrealloc(s->last, s->lcap * sizeof(double));
+                }
+                c = s->nchan++;
+                im_put(&s->chan, key, c);
+                s->last[c] = at;
+            }
+            if (at < s->last[c]) at = s->last[c];
+            s->last[c] = at;
+        }
+
+        int k = slot_get(s);
+        unsigned char *p = s->mbuf + (size_t)k * s->slot;
+        memset(p, 0, s->slot);
+        memcpy(p, out_bytes(o, i), (size_t)e->len < s->slot ? (size_t)e->len : s->slot);
+        s->msrc[k] = src;
+        s->mtag[k] = e->tag;
+        eq_push(&s->q, (Event){ at, 0, SIM_MSG, e->dst, k, 0, 0 });
+    }
+    out_clear(o);
+}
+
+/* keep a SIM_TIMER pending for the rank's earliest lease end or hedge */
+static void sim_arm(Sim *s, int node) {
+    Node *nd = &s->nodes[node];
+    if (!nd->req) return;
+    double t = req_next_timer(nd->req);
+    if (t < 0 || (nd->timer_at >= 0 && nd->timer_at <= t)) return;
+    nd->timer_at = t;
+    eq_push(&s->q, (Event){ t > s->now ? t : s->now, 0, SIM_TIMER, node, 0, 0, 0 });
+}
+
+/* run the rank's state machine on message slot k */
+static void sim_handle(Sim *s, int node, int k) {
+    Node *nd = &s->nodes[node];
+    const unsigned char *p = s->mbuf + (size_t)k * s->slot;
+    Msg msg;
+    memcpy(&msg, p, sizeof(Msg));
+    int nw = msg.nwords < s->gw ? msg.nwords : s->gw;
+    if (nw < 0) nw = 0;
+    memcpy(s->mgs, p + sizeof(Msg), (size_t)nw * sizeof(uint64_t));
+    gs_zero(s->mgs + nw, s->gw - nw);
+    int tag = s->mtag[k], src = s->msrc[k];
+    s->mfree[s->nfree++] = k;
+
+    if (nd->mgr && mgr_tag(tag)) mgr_on_msg(nd->mgr, &msg, s->mgs, tag, src, &s->out);
+    else if (nd->req) req_on_msg(nd->req, &msg, tag, src, s->now, &s->out);
+
+    nd->free_at = s->now + s->opt->service;
+    sim_flush(s, node, nd->free_at);
+    sim_arm(s, node);
+}
+
+/* a message reaches its rank: handled now, or queued behind the rank's
+   current work */
+static void sim_deliver(Sim *s, int node, int k) {
+    Node *nd = &s->nodes[node];
+    if (!nd->running && nd->free_at <= s->now) { sim_handle(s, node, k); return; }
+    if (nd->in == nd->icap) {
+        int cap = nd->icap ? 2 * nd->icap : 16;
+        int *b = xrealloc(NULL, cap * sizeof(int));
+        for (int i = 0; i < nd->in; ++i) b[i] = nd->inbox[(nd->ihead + i) % nd->icap];
+        free(nd->inbox);
+        nd->inbox = b; nd->icap = cap; nd->ihead = 0;
+    }
+    nd->inbox[(nd->ihead + nd->in++) % nd->icap] = k;
+    if (!nd->running) {
+        nd->running = 1;
+        eq_push(&s->q, (Event){ nd->free_at, 0, SIM_RUN, node, 0, 0, 0 });
+    }
+}
+
+static void sim_run(Sim *s, int node) {
+    Node *nd = &s->nodes[node];
+    int k = nd->inbox[nd->ihead];
+    nd->ihead = (nd->ihead + 1) % nd->icap;
+    --nd->in;
+    sim_handle(s, node, k);
+    if (nd->in) eq_push(&s->q, (Event){ nd->free_at, 0, SIM_RUN, node, 0, 0, 0 });
+    else nd->running = 0;
+}
+
+/* req.c's hooks: grants are taken up as events of their own, after the
+   step that produced them */
+static int on_grant(void *ctx, int c, int res, int seq, int group) {
+    Node *nd = ctx;
+    (void)seq;
+    Sim *s = sim_clock_of;
+    eq_push(&s->q, (Event){ s->now, 0, SIM_GRANT, (int)(nd - s->nodes), c, res, group });
+    return 1;
+}
+static int on_gave_up(void *ctx, int c, int seq) { (void)ctx; (void)c; (void)seq; return 0; }
+
+/**************************************************************************
+ * workload
+ **************************************************************************/
+static int first_req(const Sim *s) { return s->cfg->symmetric ? 0 : s->cfg->nmgr; }
+
+/* replay: the client's next request as a SIM_ARRIVE; 0 if it has none
+   left. one still in its CS when the request is due arrives on exit */
+static int rp_arrival(Sim *s, int node, int c) {
+    Virt *x = &s->nodes[node].v[c];
+    if (!rp_next(s->rp, (node - first_req(s)) * s->n + c, &x->due, &x->cs, &x->rp_res, x->gs)) return 0;
+    eq_push(&s->q, (Event){ x->due > s->now ? x->due : s->now, 0, SIM_ARRIVE, node, c, 0, 0 });
+    return 1;
+}
+
+static void wl_arrive(Sim *s, int node, int c) {
+    if (s->ended) return;
+    const Workload *wl = &s->cfg->wl;
+    Node *nd = &s->nodes[node];
+    Virt *x = &nd->v[c];
+    int rid = rid_of(node, c, s->n);
+    x->t_arr = s->rp ? x->due : s->now;
+    /* a replayed request with no set uses the client's home set */
+    int picked = s->rp ? gs_first(x->gs, s->gw) >= 0 : wl_pick_gset(wl, &x->ws, x->gs, s->gw);
+    if (!picked) cfg_home_set(s->cfg, rid, x->gs);
+    if (s->rp && x->rp_res >= 0) for (int i = 0; i < wl->hold; ++i) x->res[i] = x->rp_res + i;
+    else wl_pick_res(wl, &x->ws, x->res);
+    x->held = 0;
+    req_request(nd->req, c, x->res[0], ++x->seq, x->gs, s->now, &s->out);
+    sim_flush(s, node, s->now);
+    sim_arm(s, node);
+}
+
+/* resources are taken one at a time in ascending order */
+static void wl_granted(Sim *s, int node, int c, int group) {
+    if (s->ended) return;
+    const Workload *wl = &s->cfg->wl;
+    Node *nd = &s->nodes[node];
+    Virt *x = &nd->v[c];
+    x->group[x->held++] = group;
+    if (x->held < wl->hold) {
+        req_request(nd->req, c, x->res[x->held], ++x->seq, x->gs, s->now, &s->out);
+        sim_flush(s, node, s->now);
+        sim_arm(s, node);
+        return;
+    }
+    x->t_enter = s->now;
+    eq_push(&s->q, (Event){ s->now + (s->rp ? x->cs : wl_cs_time(wl, &x->ws)), 0, SIM_EXIT, node, c, 0, 0 });
+}
+
+static void wl_exit(Sim *s, int node, int c) {
+    if (s->ended) return;
+    const Workload *wl = &s->cfg->wl;
+    Node *nd = &s->nodes[node];
+    Virt *x = &nd->v[c];
+    for (int i = wl->hold - 1; i >= 0; --i) {
+        req_release(nd->req, c, x->res[i], s->now, &s->out);
+        st_cs(&s->stats, rid_of(node, c, s->n), x->res[i], x->group[i], x->t_arr, x->t_enter, s->now);
+    }
+    /* fixed workload: the rank shuts down with its last client */
+    int more = s->rp ? rp_arrival(s, node, c) : !wl->entries || --x->left;
+    if (!more && --nd->busy == 0) req_shutdown(nd->req, s->now, &s->out);
+    sim_flush(s, node, s->now);
+    sim_arm(s, node);
+    if (more && !s->rp)
+        eq_push(&s->q, (Event){ wl_next_arrival(wl, &x->ws, s->now), 0, SIM_ARRIVE, node, c, 0, 0 });
+}
+
+/* end of the measured run: requesters see their requests through */
+static void sim_end(Sim *s) {
+    s->ended = 1;
+    for (int r = first_req(s); r < s->nnodes; ++r) {
+        req_shutdown(s->nodes[r].req, s->now, &s->out);
+        sim_flush(s, r, s->now);
+        sim_arm(s, r);
+    }
+}
+
+/**************************************************************************
+ * main
+ **************************************************************************/
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s --ranks=N [--latency=fixed:D|uniform:LO:HI|exp:MIN:MEAN|lognormal:MED:SIG]\n"
+                    "       [--service=S] [gme_mpi options]\n", prog);
+    cfg_usage(stderr, prog);
+}
+
+int main(int argc, char **argv) {
+    SimOpt opt = { 16, LAT_FIXED, 10e-6, 0, "fixed:1e-05", 0 };
+    Config cfg; cfg_defaults(&cfg);
+    char err[512];
+    for (int i = 1; i < argc; ++i) {
+        int rc = sim_parse_arg(&opt, argv[i]);
+        if (rc == 0) { if (cfg_parse_arg(&cfg, argv[i], err, sizeof(err)) == 1) continue; }
+        else if (rc == 1) continue;
+        else snprintf(err, sizeof(err), "bad value in %s", argv[i]);
+        fprintf(stderr, "%s\n", err);
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (cfg.symmetric) cfg.nmgr = opt.ranks;
+    if (cfg_check(&cfg, opt.ranks, err, sizeof(err)) != 0) {
+        fprintf(stderr, "%s\n", err);
+        return EXIT_FAILURE;
+    }
+
+    Coterie cot;
+    if (cot_build(&cot, cfg.coterie, cfg.nmgr) != 0 || !cot_check(&cot)) {
+        fprintf(stderr, "cannot build %s coterie over %d managers\n", cot_kind_name(cfg.coterie), cfg.nmgr);
+        return EXIT_FAILURE;
+    }
+
+    Sim s;
+    memset(&s, 0, sizeof(s));
+    s.cfg = &cfg; s.opt = &opt;
+    s.gw = GSET_WORDS(cfg.ngroups);
+    s.n = cfg.clients;
+    s.slot = sizeof(Msg) + s.gw * sizeof(uint64_t);
+    s.rng = (cfg.wl.seed * 0x9E3779B97F4A7C15ULL) | 1;
+    s.mgs = xrealloc(NULL, s.gw * sizeof(uint64_t));
+    im_init(&s.chan);
+    out_init(&s.out);
+    st_init(&s.stats);
+    sim_clock_of = &s;
+
+    /* one trace file, in virtual-time order */
+    if (cfg.trace_level < 0) cfg.trace_level = 0;
+    if (tr_open(cfg.trace_prefix, 0, cfg.trace_level, cfg.trace_buf, sim_clock) != 0)
+        fprintf(stderr, "cannot write %s.0.bin, tracing off\n", cfg.trace_prefix);
+    mt_open(cfg.metrics, 0, cfg.metrics_every, sim_clock);
+
+    int nreq = opt.ranks - first_req(&s);
+    if (cfg.wl.replay[0] && !(s.rp = rp_open(cfg.wl.replay, 0, nreq * s.n, cfg.ngroups, err, sizeof(err)))) {
+        fprintf(stderr, "%s\n", err);
+        return EXIT_FAILURE;
+    }
+    s.nnodes = opt.ranks;
+    s.nodes = xrealloc(NULL, s.nnodes * sizeof(Node));
+    memset(s.nodes, 0, s.nnodes * sizeof(Node));
+    int k = cfg.wl.hold;
+    Virt *virts = xrealloc(NULL, (size_t)nreq * s.n * sizeof(Virt));
+    uint64_t *gsets = xrealloc(NULL, (size_t)nreq * s.n * s.gw * sizeof(uint64_t));
+    int *slots = xrealloc(NULL, 2 * (size_t)nreq * s.n * k * sizeof(int));
+    for (int r = 0; r < s.nnodes; ++r) {
+        Node *nd = &s.nodes[r];
+        nd->timer_at = -1;
+        if (r < cfg.nmgr) nd->mgr = mgr_open(&cfg, &cot, r, &nd->lamport, NULL);
+        if (r < first_req(&s)) continue;
+
+        ReqHooks hk = { on_grant, on_gave_up, nd };
+        nd->req = req_open(&cfg, &cot, r, s.n, &nd->lamport, &hk);
+        nd->v = virts + (size_t)(r - first_req(&s)) * s.n;
+        nd->busy = s.n;
+        for (int c = 0; c < s.n; ++c) {
+            size_t i = (size_t)(r - first_req(&s)) * s.n + c;
+            Virt *x = &nd->v[c];
+            memset(x, 0, sizeof(*x));
+            wl_start(&cfg.wl, &x->ws, rid_of(r, c, s.n), 0.0);
+            x->gs = gsets + i * s.gw;
+            x->res = slots + 2 * i * k;
+            x->group = x->res + k;
+            x->left = cfg.wl.entries;
+            if (!s.rp) eq_push(&s.q, (Event){ wl_next_arrival(&cfg.wl, &x->ws, 0.0), 0, SIM_ARRIVE, r, c, 0, 0 });
+            else if (!rp_arrival(&s, r, c)) --nd->busy;
+        }
+        /* nothing to replay for any of its clients */
+        if (!nd->busy) {
+            req_shutdown(nd->req, 0.0, &s.out);
+            sim_flush(&s, r, 0.0);
+            sim_arm(&s, r);
+        }
+    }
+    if (!cfg.wl.entries && !s.rp) eq_push(&s.q, (Event){ cfg.wl.duration, 0, SIM_END, -1, 0, 0, 0 });
+
+    struct timespec w0, w1;
+    clock_gettime(CLOCK_MONOTONIC, &w0);
+    while (s.q.n) {
+        Event e = eq_pop(&s.q);
+        s.now = e.t;
+        ++s.events;
+        switch (e.kind) {
+            case SIM_MSG:    sim_deliver(&s, e.node, e.a); break;
+            case SIM_RUN:    sim_run(&s, e.node); break;
+            case SIM_TIMER: {
+                Node *nd = &s.nodes[e.node];
+                if (nd->timer_at >= 0 && nd->timer_at <= s.now) nd->timer_at = -1;
+                req_expire(nd->req, s.now, &s.out);
+                sim_flush(&s, e.node, s.now);
+                sim_arm(&s, e.node);
+                break;
+            }
+            case SIM_ARRIVE: wl_arrive(&s, e.node, e.a); break;
+            case SIM_GRANT:  wl_granted(&s, e.node, e.a, e.c); break;
+            case SIM_EXIT:   wl_exit(&s, e.node, e.a); break;
+            case SIM_END:    sim_end(&s); break;
+        }
+        mt_tick();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &w1);
+    double wall = (w1.tv_sec - w0.tv_sec) + 1e-9 * (w1.tv_nsec - w0.tv_nsec);
+    tr_close();
+    mt_close();
+
+    /* with the queue dry, everything must have been seen through */
+    int stuck_sess = 0, stuck_res = 0;
+    for (int r = 0; r < s.nnodes; ++r) {
+        if (s.nodes[r].req) stuck_sess += req_busy(s.nodes[r].req);
+        if (s.nodes[r].mgr) stuck_res += mgr_active(s.nodes[r].mgr);
+    }
+
+    char meta[640];
+    snprintf(meta, sizeof(meta),
+             "\"ranks\": %d, \"managers\": %d, \"requesters\": %d, \"clients\": %d, "
+             "\"symmetric\": %s, \"coterie\": \"%s\", \"groups\": %d,\n"
+             "  \"simulated\": true, \"latency\": \"%s\", \"service_s\": %g, \"events\": %ld, "
+             "\"wall_s\": %.3f, \"stuck_sessions\": %d, \"stuck_resources\": %d",
+             opt.ranks, cfg.nmgr, nreq, cfg.clients, cfg.symmetric ? "true" : "false",
+             cot_kind_name(cfg.coterie), cfg.ngroups, opt.lat_spec, opt.service, s.events, wall,
+             stuck_sess, stuck_res);
+    bench_write(s.stats.rec, s.stats.n, s.sent, s.local, &cfg.wl, meta, cfg.out[0] ? cfg.out : NULL);
+    if (cfg.metrics[0])
+        mt_write(&mt, opt.ranks, s.now, strcmp(cfg.metrics, "-") == 0 ? NULL : cfg.metrics, cfg.metrics_prom);
+
+    for (int r = 0; r < s.nnodes; ++r) {
+        if (s.nodes[r].mgr) mgr_close(s.nodes[r].mgr);
+        if (s.nodes[r].req) req_close(s.nodes[r].req);
+        free(s.nodes[r].inbox);
+    }
+    free(s.nodes); free(virts); free(gsets); free(slots);
+    free(s.q.h);
+    free(s.mbuf); free(s.msrc); free(s.mtag); free(s.mfree);
+    im_free(&s.chan); free(s.last);
+    out_free(&s.out);
+    free(s.mgs);
+    st_free(&s.stats);
+    rp_close(s.rp);
+    cfg_free(&cfg);
+    cot_free(&cot);
+    return stuck_sess || stuck_res ? 2 : 0;
+}
@@ -0,0 +1,134 @@
+/**************************************************************************
+ * gme_trace - offline decoder for gme_mpi traces
+ *
+ *   gme_trace [-t] [--no-color] trace.*.bin
+ *
+ * merges the per-rank files by Lamport time (ties by rank, then emission
+ * order) and prints the log lines described in trace.h. -t prefixes each
+ * line with the emitting rank's wall time relative to the first event.
+ **************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "trace.h"
+
+#define TR_FMT(id, lvl, clr, fmt)  fmt,
+#define TR_CLR(id, lvl, clr, fmt)  clr,
+static const char *EV_FMT[EV_COUNT] = { TRACE_EVENTS(TR_FMT) };
+static const char *EV_CLR[EV_COUNT] = { TRACE_EVENTS(TR_CLR) };
+
+#define CHUNK 4096
+
+typedef struct {
+    FILE *f;
+    int rank;
+    TraceEv buf[CHUNK];
+    int n, i;
+} Reader;
+
+/* current event of r, or NULL at end of file */
+static const TraceEv *rd_peek(Reader *r) {
+    if (r->i == r->n) {
+        r->n = r->f ? (int)fread(r->buf, sizeof(TraceEv), CHUNK, r->f) : 0;
+        r->i = 0;
+        if (r->n == 0) return NULL;
+    }
+    return &r->buf[r->i];
+}
+
+/* the groups of word i, then how many of the n members are not shown */
+static void print_gset(FILE *out, int i, uint64_t word, int n) {
+    fputc('{', out);
+    for (int b = 0; b < 64; ++b)
+        if ((word >> b) & 1) { fprintf(out, " g%d", i * 64 + b); --n; }
+    if (n > 0) fprintf(out, " +%d more", n);
+    fputs(" }", out);
+}
+
+static void print_event(FILE *out, const TraceEv *e, int color, double t0, int show_time) {
+    if (e->id >= EV_COUNT) { fprintf(out, "<unknown event %u>\n", e->id); return; }
+    if (show_time) fprintf(out, "%12.6f ", e->t - t0);
+    if (color) fputs(EV_CLR[e->id], out);
+
+    int k = 0;
+    for (const char *p = EV_FMT[e->id]; *p; ++p) {
+        if (p[0] != '%' || !p[1]) { fputc(*p, out); continue; }
+        ++p;
+        if (*p == 'd') {
+            fprintf(out, "%d", k < e->nargs ? e->a[k] : 0); ++k;
+        } else if (*p == 'L') {
+            fprintf(out, "%d", e->lamport);
+        } else if (*p == 'G') {
+            int i = 0, n = 0; uint64_t word = 0;
+            if (k + 3 < e->nargs) {
+                i = e->a[k];
+                word = (uint64_t)(uint32_t)e->a[k + 1] | (uint64_t)(uint32_t)e->a[k + 2] << 32;
+                n = e->a[k + 3];
+            }
+            print_gset(out, i, word, n);
+            k += 4;
+        } else {
+            fputc('%', out); fputc(*p, out);
+        }
+    }
+    if (color) fputs(CLR_RST, out);
+    fputc('\n', out);
+}
+
+int main(int argc, char **argv) {
+    int color = 1, show_time = 0;
+    Reader *rd = calloc(argc, sizeof(Reader));
+    int nr = 0;
+    if (!rd) { fprintf(stderr, "out of memory\n"); return EXIT_FAILURE; }
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-t") == 0) { show_time = 1; continue; }
+        if (strcmp(argv[i], "--no-color") == 0) { color = 0; continue; }
+        if (argv[i][0] == '-') {
+            fprintf(stderr, "usage: %s [-t] [--no-color] trace.*.bin\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+        FILE *f = fopen(argv[i], "rb");
+        TraceHdr h;
+        if (!f) { perror(argv[i]); return EXIT_FAILURE; }
+        if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, TR_MAGIC, sizeof(TR_MAGIC)) != 0 ||
+            h.evsize != (int32_t)sizeof(TraceEv)) {
+            fprintf(stderr, "%s: not a gme_mpi trace (or a different version)\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+        rd[nr].f = f;
+        rd[nr].rank = h.rank;
+        ++nr;
+    }
+    if (nr == 0) {
+        fprintf(stderr, "usage: %s [-t] [--no-color] trace.*.bin\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    double t0 = 0; int have_t0 = 0;
+    for (int i = 0; i < nr; ++i) {
+        const TraceEv *e = rd_peek(&rd[i]);
+        if (e && (!have_t0 || e->t < t0)) { t0 = e->t; have_t0 = 1; }
+    }
+
+    /* k-way merge; each file is already in Lamport order */
+    while (1) {
+        int best = -1;
+        const TraceEv *be = NULL;
+        for (int i = 0; i < nr; ++i) {
+            const TraceEv *e = rd_peek(&rd[i]);
+            if (!e) continue;
+            if (!be || e->lamport < be->lamport ||
+                (e->lamport == be->lamport && rd[i].rank < rd[best].rank)) { best = i; be = e; }
+        }
+        if (!be) break;
+        print_event(stdout, be, color, t0, show_time);
+        ++rd[best].i;
+    }
+
+    for (int i = 0; i < nr; ++i) fclose(rd[i].f);
+    free(rd);
+    return 0;
+}
@@ -0,0 +1,109 @@
+/**************************************************************************
+ * gme_wl - converter for replay workloads (bench.h)
+ *
+ *   gme_wl [--groups=N] < listing > file.wl     text to replay file
+ *   gme_wl -d file.wl                           replay file to text
+ *
+ * a listing has one request per line, "#" starts a comment:
+ *
+ *   REQ  ARRIVAL  CS  RES  GROUPS
+ *   0    0.0010   0.0005  -1  0+1
+ *
+ * REQ is the logical requester (0-based over the job's requesters),
+ * ARRIVAL seconds from the start of the run, CS the hold time, RES the
+ * first resource (-1 = drawn by the run), GROUPS the set as g+g+... or
+ * "-" for the requester's home set. both directions stream, so traces
+ * of any size convert in constant memory. listings sorted by arrival
+ * keep the readers' look-ahead small.
+ **************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "bench.h"
+#include "gset.h"
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [--groups=N] < listing > file.wl\n       %s -d file.wl\n", prog, prog);
+    exit(EXIT_FAILURE);
+}
+
+/* "0+3+5" or "-" into gs; -1 on a group outside 0..ngroups-1 */
+static int parse_groups(const char *s, int ngroups, uint64_t *gs, int gw) {
+    gs_zero(gs, gw);
+    if (strcmp(s, "-") == 0) return 0;
+    while (*s) {
+        char *end;
+        long g = strtol(s, &end, 10);
+        if (end == s || g < 0 || g >= ngroups) return -1;
+        gs_set(gs, (int)g);
+        s = end;
+        if (*s == '+') ++s;
+        else if (*s) return -1;
+    }
+    return 0;
+}
+
+static int encode(int ngroups) {
+    int gw = GSET_WORDS(ngroups);
+    uint64_t *gs = malloc(gw * sizeof(uint64_t));
+    RpHeader h = { RP_MAGIC, RP_VERSION, (uint32_t)ngroups, 0 };
+    fwrite(&h, sizeof(h), 1, stdout);
+
+    char line[4096], groups[4000];
+    long lineno = 0, n = 0;
+    while (fgets(line, sizeof(line), stdin)) {
+        ++lineno;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        RpRecord r;
+        int k = sscanf(line, "%d %lf %lf %d %3999s", &r.req, &r.t, &r.cs, &r.res, groups);
+        if (k <= 0) continue;
+        if (k != 5 || r.req < 0 || r.t < 0 || r.cs < 0 || parse_groups(groups, ngroups, gs, gw)) {
+            fprintf(stderr, "line %ld: expected REQ ARRIVAL CS RES GROUPS (groups below %d)\n", lineno, ngroups);
+            free(gs);
+            return EXIT_FAILURE;
+        }
+        fwrite(&r, sizeof(r), 1, stdout);
+        fwrite(gs, sizeof(uint64_t), gw, stdout);
+        ++n;
+    }
+    free(gs);
+    if (fflush(stdout) != 0) { perror("write"); return EXIT_FAILURE; }
+    fprintf(stderr, "%ld requests over %d groups\n", n, ngroups);
+    return EXIT_SUCCESS;
+}
+
+static int decode(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) { perror(path); return EXIT_FAILURE; }
+    RpHeader h;
+    if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, RP_MAGIC, 4) || h.version != RP_VERSION) {
+        fprintf(stderr, "%s: not a replay file (or a different version)\n", path);
+        fclose(f);
+        return EXIT_FAILURE;
+    }
+    int gw = GSET_WORDS(h.ngroups);
+    uint64_t *gs = malloc((gw ? gw : 1) * sizeof(uint64_t));
+    printf("# %u groups\n", h.ngroups);
+    RpRecord r;
+    while (fread(&r, sizeof(r), 1, f) == 1 && fread(gs, sizeof(uint64_t), gw, f) == (size_t)gw) {
+        printf("%d %.9g %.9g %d ", r.req, r.t, r.cs, r.res);
+        int any = 0;
+        GS_FOREACH(g, gs, gw) printf(any++ ? "+%d" : "%d", g);
+        printf(any ? "\n" : "-\n");
+    }
+    free(gs);
+    fclose(f);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv) {
+    int ngroups = 2;
+    if (argc == 3 && strcmp(argv[1], "-d") == 0) return decode(argv[2]);
+    if (argc == 2 && strncmp(argv[1], "--groups=", 9) == 0) ngroups = atoi(argv[1] + 9);
+    else if (argc != 1) usage(argv[0]);
+    if (ngroups < 1) usage(argv[0]);
+    return encode(ngroups);
+}
@@ -0,0 +1,64 @@
+#ifndef GSET_H
+#define GSET_H
+
+/**************************************************************************
+ * group sets - word-packed bitsets sized at runtime
+ *
+ * a set over ngroups groups is GSET_WORDS(ngroups) uint64_t words; bit g
+ * of word g/64 is group g. all operations work a word at a time.
+ **************************************************************************/
+#include <stdint.h>
+#include <string.h>
+
+#define GSET_WORDS(ngroups) (((ngroups) + 63) / 64)
+
+static inline void gs_zero(uint64_t *s, int w) { memset(s, 0, (size_t)w * sizeof(uint64_t)); }
+static inline void gs_copy(uint64_t *d, const uint64_t *s, int w) { memcpy(d, s, (size_t)w * sizeof(uint64_t)); }
+static inline void gs_set(uint64_t *s, int g) { s[g >> 6] |= (uint64_t)1 << (g & 63); }
+static inline void gs_clear(uint64_t *s, int g) { s[g >> 6] &= ~((uint64_t)1 << (g & 63)); }
+static inline int  gs_test(const uint64_t *s, int g) { return (int)((s[g >> 6] >> (g & 63)) & 1); }
+
+static inline void gs_or(uint64_t *d, const uint64_t *s, int w) { for (int i = 0; i < w; ++i) d[i] |= s[i]; }
+
+/* a & b != {} */
+static inline int gs_intersects(const uint64_t *a, const uint64_t *b, int w) {
+    for (int i = 0; i < w; ++i) if (a[i] & b[i]) return 1;
+    return 0;
+}
+
+/* |s| and |a & b| */
+static inline int gs_count(const uint64_t *s, int w) {
+    int n = 0;
+    for (int i = 0; i < w; ++i) n += __builtin_popcountll(s[i]);
+    return n;
+}
+static inline int gs_count_and(const uint64_t *a, const uint64_t *b, int w) {
+    int n = 0;
+    for (int i = 0; i < w; ++i) n += __builtin_popcountll(a[i] & b[i]);
+    return n;
+}
+
+/* smallest member >= from, or -1 */
+static inline int gs_next(const uint64_t *s, int w, int from) {
+    if (from < 0) from = 0;
+    int i = from >> 6;
+    if (i >= w) return -1;
+    uint64_t x = s[i] & (~(uint64_t)0 << (from & 63));
+    while (1) {
+        if (x) return (i << 6) + __builtin_ctzll(x);
+        if (++i >= w) return -1;
+        x = s[i];
+    }
+}
+static inline int gs_first(const uint64_t *s, int w) { return gs_next(s, w, 0); }
+
+#define GS_FOREACH(g, s, w) for (int g = gs_first(s, w); g >= 0; g = gs_next(s, w, g + 1))
+
+/* 32-bit fold of the set, e.g. for spreading requests over quorums */
+static inline unsigned gs_fold(const uint64_t *s, int w) {
+    uint64_t h = 0;
+    for (int i = 0; i < w; ++i) h ^= s[i];
+    return (unsigned)(h ^ (h >> 32));
+}
+
+#endif
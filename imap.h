@@ -0,0 +1,84 @@
+#ifndef IMAP_H
+#define IMAP_H
+
+/**************************************************************************
+ * imap - open-addressing hash map from 64-bit keys to non-negative ints
+ *
+ * linear probing over a power-of-two table kept at most half full;
+ * deletion shifts the following run back, so there are no tombstones and
+ * a map that shrinks back to a few keys probes as fast as a fresh one.
+ **************************************************************************/
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "wire.h"
+
+typedef struct {
+    uint64_t *key;
+    int *val;               /* -1 = empty slot */
+    int cap, n;
+} IMap;
+
+static inline void im_init(IMap *m) { m->key = NULL; m->val = NULL; m->cap = m->n = 0; }
+static inline void im_free(IMap *m) { free(m->key); free(m->val); im_init(m); }
+
+static inline uint32_t im_hash(uint64_t k) {
+    k ^= k >> 33; k *= 0xFF51AFD7ED558CCDULL;
+    k ^= k >> 33; k *= 0xC4CEB9FE1A85EC53ULL;
+    return (uint32_t)(k ^ (k >> 33));
+}
+
+/* value of key, -1 if absent */
+static inline int im_get(const IMap *m, uint64_t k) {
+    if (!m->n) return -1;
+    for (uint32_t i = im_hash(k) & (m->cap - 1);; i = (i + 1) & (m->cap - 1)) {
+        if (m->val[i] < 0) return -1;
+        if (m->key[i] == k) return m->val[i];
+    }
+}
+
+static inline void im_put(IMap *m, uint64_t k, int v);
+
+static inline void im_grow(IMap *m) {
+    IMap old = *m;
+    m->cap = old.cap ? 2 * old.cap : 16;
+    m->n = 0;
+    m->key = xrealloc(NULL, m->cap * sizeof(uint64_t));
+    m->val = xrealloc(NULL, m->cap * sizeof(int));
+    for (int i = 0; i < m->cap; ++i) m->val[i] = -1;
+    for (int i = 0; i < old.cap; ++i) if (old.val[i] >= 0) im_put(m, old.key[i], old.val[i]);
+    free(old.key); free(old.val);
+}
+
+/* insert or overwrite */
+static inline void im_put(IMap *m, uint64_t k, int v) {
+    if (2 * (m->n + 1) > m->cap) im_grow(m);
+    uint32_t i = im_hash(k) & (m->cap - 1);
+    while (m->val[i] >= 0 && m->key[i] != k) i = (i + 1) & (m->cap - 1);
+    if (m->val[i] < 0) ++m->n;
+    m->key[i] = k; m->val[i] = v;
+}
+
+/* remove key; 0 if it was absent */
+static inline int im_del(IMap *m, uint64_t k) {
+    if (!m->n) return 0;
+    uint32_t mask = m->cap - 1, i = im_hash(k) & mask;
+    for (;; i = (i + 1) & mask) {
+        if (m->val[i] < 0) return 0;
+        if (m->key[i] == k) break;
+    }
+    /* pull later members of the run into the hole when their home
+       position does not lie cyclically in (hole, j] */
+    for (uint32_t j = (i + 1) & mask; m->val[j] >= 0; j = (j + 1) & mask) {
+        uint32_t h = im_hash(m->key[j]) & mask;
+        if (((j - h) & mask) >= ((j - i) & mask)) {
+            m->key[i] = m->key[j]; m->val[i] = m->val[j];
+            i = j;
+        }
+    }
+    m->val[i] = -1;
+    --m->n;
+    return 1;
+}
+
+#endif
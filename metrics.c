@@ -0,0 +1,174 @@
+#include "metrics.h"
+
+#include <stdio.h>
+#include <string.h>
+
+Metrics mt;
+
+static const char *TAG_NAME[MT_NTAGS] = {
+    "REQUEST", "OK", "LOCK", "ENTER", "RELEASE", "NONEED", "CANCEL",
+    "CANCELLED", "FINISHED", "OVER", "REVOKE", "COHORT",
+    "SUB_REQUEST", "SUB_GRANT", "SUB_RELEASE", "SUB_DONE",
+};
+static const char *MSTATE_NAME[MT_MSTATES] = { "VACANT", "WAITLOCK", "LOCKED", "RELEASING", "WAITCANCEL" };
+static const char *RSTATE_NAME[MT_RSTATES] = { "IDLE", "WAIT", "IN", "OUT", "LEASE" };
+
+static double no_clock(void) { return 0; }
+static double (*mt_clock)(void) = no_clock;
+
+static FILE *mt_snap;
+static int mt_rank;
+static double mt_every, mt_t0, mt_next;
+
+/**************************************************************************
+ * JSON - one object; sep goes between members ("\n  " or " ")
+ **************************************************************************/
+static void json_tags(FILE *f, const char *key, const int64_t *a) {
+    fprintf(f, "\"%s\": {", key);
+    for (int t = 0; t < MT_NTAGS; ++t) fprintf(f, "%s\"%s\": %lld", t ? ", " : "", TAG_NAME[t], (long long)a[t]);
+    fprintf(f, "}");
+}
+
+static void json_states(FILE *f, const char *key, const int64_t *ns, const char **names, int n) {
+    fprintf(f, "\"%s\": {", key);
+    for (int s = 0; s < n; ++s) fprintf(f, "%s\"%s\": %.6f", s ? ", " : "", names[s], ns[s] * 1e-9);
+    fprintf(f, "}");
+}
+
+/* buckets up to the last non-empty one, as [upper bound, count] pairs */
+static void json_hist(FILE *f, const char *key, const int64_t *h, double sum, double scale) {
+    int64_t n = 0;
+    int last = 0;
+    for (int b = 0; b < MT_BUCKETS; ++b) if (h[b]) { n += h[b]; last = b; }
+    fprintf(f, "\"%s\": {\"n\": %lld, \"mean\": %.3f, \"buckets\": [", key, (long long)n,
+            n ? sum * scale / n : 0.0);
+    for (int b = 0; n && b <= last; ++b)
+        fprintf(f, "%s[%lld, %lld]", b ? ", " : "", 1LL << b, (long long)h[b]);
+    fprintf(f, "]}");
+}
+
+static void json_body(FILE *f, const Metrics *m, double elapsed, const char *sep) {
+    json_tags(f, "sent", m->sent);
+    fprintf(f, ",%s", sep);
+    json_tags(f, "recv", m->recv);
+    fprintf(f, ",%s\"stale\": %lld, \"stray\": %lld, \"cancels_per_sec\": %.3f,%s", sep, (long long)m->stale,
+            (long long)m->stray, elapsed > 0 ? m->sent[TAG_CANCEL] / elapsed : 0.0, sep);
+    fprintf(f, "\"fast_hits\": %lld, \"fast_misses\": %lld, \"cohort_joins\": %lld, \"sub_grants\": %lld,%s",
+            (long long)m->fast_hit, (long long)m->fast_miss, (long long)m->cohort_join, (long long)m->sub_grant, sep);
+    json_hist(f, "queue_depth", m->qdepth, (double)m->qdepth_sum, 1.0);
+    fprintf(f, ",%s", sep);
+    json_hist(f, "ok_to_lock_us", m->ok_lock, (double)m->ok_lock_ns, 1e-3);
+    fprintf(f, ",%s", sep);
+    json_hist(f, "release_to_over_us", m->rel_over, (double)m->rel_over_ns, 1e-3);
+    fprintf(f, ",%s", sep);
+    json_states(f, "manager_state_s", m->mstate_ns, MSTATE_NAME, MT_MSTATES);
+    fprintf(f, ",%s", sep);
+    json_states(f, "requester_state_s", m->rstate_ns, RSTATE_NAME, MT_RSTATES);
+}
+
+/**************************************************************************
+ * Prometheus text exposition format
+ **************************************************************************/
+static void prom_tags(FILE *f, const char *name, const char *help, const int64_t *a) {
+    fprintf(f, "# HELP %s %s\n# TYPE %s counter\n", name, help, name);
+    for (int t = 0; t < MT_NTAGS; ++t) fprintf(f, "%s{tag=\"%s\"} %lld\n", name, TAG_NAME[t], (long long)a[t]);
+}
+
+static void prom_counter(FILE *f, const char *name, const char *help, int64_t v) {
+    fprintf(f, "# HELP %s %s\n# TYPE %s counter\n%s %lld\n", name, help, name, name, (long long)v);
+}
+
+static void prom_states(FILE *f, const char *name, const char *help, const int64_t *ns, const char **names,
+                        int n) {
+    fprintf(f, "# HELP %s %s\n# TYPE %s counter\n", name, help, name);
+    for (int s = 0; s < n; ++s) fprintf(f, "%s{state=\"%s\"} %.9f\n", name, names[s], ns[s] * 1e-9);
+}
+
+/* cumulative buckets; bounds and sum are scaled by `scale` into the unit */
+static void prom_hist(FILE *f, const char *name, const char *help, const int64_t *h, double sum, double scale) {
+    fprintf(f, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    int64_t c = 0;
+    for (int b = 0; b < MT_BUCKETS - 1; ++b) {
+        c += h[b];
+        fprintf(f, "%s_bucket{le=\"%g\"} %lld\n", name, (double)(1LL << b) * scale, (long long)c);
+    }
+    c += h[MT_BUCKETS - 1];
+    fprintf(f, "%s_bucket{le=\"+Inf\"} %lld\n%s_sum %.9g\n%s_count %lld\n", name, (long long)c, name, sum, name,
+            (long long)c);
+}
+
+static void prom_body(FILE *f, const Metrics *m, int ranks, double elapsed) {
+    fprintf(f, "# HELP gme_ranks Ranks the metrics are summed over.\n# TYPE gme_ranks gauge\ngme_ranks %d\n", ranks);
+    fprintf(f, "# HELP gme_elapsed_seconds Length of the run.\n# TYPE gme_elapsed_seconds gauge\n"
+               "gme_elapsed_seconds %.6f\n", elapsed);
+    prom_tags(f, "gme_messages_sent_total", "Protocol messages sent, by tag.", m->sent);
+    prom_tags(f, "gme_messages_received_total", "Protocol messages received, by tag.", m->recv);
+    prom_counter(f, "gme_stale_replies_total", "Replies ignored for an older request.", m->stale);
+    prom_counter(f, "gme_stray_messages_total", "Messages ignored in a state with no use for them.", m->stray);
+    prom_counter(f, "gme_fast_path_hits_total", "Acquires taken on the RMA fast path.", m->fast_hit);
+    prom_counter(f, "gme_fast_path_misses_total", "Fast-path attempts sent on to the message protocol.", m->fast_miss);
+    prom_counter(f, "gme_cohort_joins_total", "Acquires that joined a node-local cohort.", m->cohort_join);
+    prom_counter(f, "gme_sub_grants_total", "Acquires a node's sub-manager granted locally.", m->sub_grant);
+    prom_hist(f, "gme_queue_depth", "Manager queue length after each insert.", m->qdepth,
+              (double)m->qdepth_sum, 1.0);
+    prom_hist(f, "gme_ok_to_lock_seconds", "Manager OK sent to LOCK received.", m->ok_lock,
+              m->ok_lock_ns * 1e-9, 1e-6);
+    prom_hist(f, "gme_release_to_over_seconds", "Pivot RELEASE to OVER at a manager.", m->rel_over,
+              m->rel_over_ns * 1e-9, 1e-6);
+    prom_states(f, "gme_manager_state_seconds_total", "Resource time in each manager state.", m->mstate_ns,
+                MSTATE_NAME, MT_MSTATES);
+    prom_states(f, "gme_requester_state_seconds_total", "Session time in each requester state.", m->rstate_ns,
+                RSTATE_NAME, MT_RSTATES);
+}
+
+/**************************************************************************
+ * api
+ **************************************************************************/
+void mt_open(const char *path, int rank, double every, double (*clock)(void)) {
+    memset(&mt, 0, sizeof(mt));
+    mt_clock = clock;
+    mt_rank = rank;
+    mt_t0 = clock();
+    mt_every = 0;
+    if (every <= 0 || !path) return;
+
+    char p[512];
+    snprintf(p, sizeof(p), "%s.%d", path, rank);
+    mt_snap = fopen(p, "w");
+    if (!mt_snap) { fprintf(stderr, "metrics: cannot write %s, no snapshots\n", p); return; }
+    mt_every = every;
+    mt_next = mt_t0 + every;
+}
+
+double mt_now(void) { return mt_clock(); }
+double mt_elapsed(void) { return mt_clock() - mt_t0; }
+
+void mt_tick(void) {
+    if (mt_every <= 0) return;
+    double t = mt_clock();
+    if (t < mt_next) return;
+    fprintf(mt_snap, "{\"t\": %.6f, \"rank\": %d, ", t - mt_t0, mt_rank);
+    json_body(mt_snap, &mt, t - mt_t0, " ");
+    fprintf(mt_snap, "}\n");
+    fflush(mt_snap);
+    while (mt_next <= t) mt_next += mt_every;
+}
+
+void mt_close(void) {
+    if (mt_snap) fclose(mt_snap);
+    mt_snap = NULL;
+    mt_every = 0;
+}
+
+void mt_write(const Metrics *m, int ranks, double elapsed, const char *path, int prom) {
+    FILE *f = path ? fopen(path, "w") : stdout;
+    if (!f) { fprintf(stderr, "metrics: cannot write %s\n", path); return; }
+    if (prom) prom_body(f, m, ranks, elapsed);
+    else {
+        fprintf(f, "{\n  \"ranks\": %d, \"elapsed_s\": %.6f,\n  ", ranks, elapsed);
+        json_body(f, m, elapsed, "\n  ");
+        fprintf(f, "\n}\n");
+    }
+    if (path) fclose(f);
+    else fflush(f);
+}
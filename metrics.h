@@ -0,0 +1,92 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+/**************************************************************************
+ * metrics - per-rank counters and histograms
+ *
+ * always on and cheap: plain increments, plus a clock read on every
+ * state change and on the OK / RELEASE steps a latency is measured from.
+ * every field is an int64_t, so a whole job's metrics are one MPI_SUM
+ * over the struct as an array; the end-of-run report is written from the
+ * sum, as JSON or Prometheus text.
+ *
+ * histograms have log2 buckets: bucket 0 counts values below 1, bucket b
+ * values in [2^(b-1), 2^b), the last one everything above. latencies are
+ * in microseconds.
+ *
+ *   sent / recv     protocol messages per tag (self-sends included)
+ *   stale           requester replies ignored for an older request
+ *   stray           messages ignored in a state that has no use for them
+ *   fast_hit/miss   acquires taken on the RMA fast path / sent on to the
+ *                   message protocol
+ *   cohort_join     acquires that joined a session another request on the
+ *                   node holds
+ *   sub_grant       acquires a node's sub-manager granted to its requesters
+ *   qdepth          a manager's queue length after each insert
+ *   ok_lock         manager: OK sent -> LOCK from that requester
+ *   rel_over        manager: pivot's RELEASE -> its OVER
+ *   mstate/rstate   nanoseconds resources / sessions spent in each state
+ **************************************************************************/
+#include <stdint.h>
+
+#include "wire.h"
+
+#define MT_NTAGS   TAG_APP_ACQUIRE      /* tags that go over the wire */
+#define MT_BUCKETS 32
+#define MT_MSTATES (M_WAITCANCEL + 1)
+#define MT_RSTATES (R_LEASE + 1)
+
+typedef struct {
+    int64_t sent[MT_NTAGS], recv[MT_NTAGS];
+    int64_t stale, stray;
+    int64_t fast_hit, fast_miss, cohort_join, sub_grant;
+    int64_t qdepth[MT_BUCKETS], qdepth_sum;
+    int64_t ok_lock[MT_BUCKETS], ok_lock_ns;
+    int64_t rel_over[MT_BUCKETS], rel_over_ns;
+    int64_t mstate_ns[MT_MSTATES], rstate_ns[MT_RSTATES];
+} Metrics;
+_Static_assert(sizeof(Metrics) % sizeof(int64_t) == 0, "Metrics is reduced as an int64_t array");
+#define MT_WORDS ((int)(sizeof(Metrics) / sizeof(int64_t)))
+
+/* this process's metrics; the step functions run on one thread per rank */
+extern Metrics mt;
+
+/* times come from clock(); snapshots of mt are appended to PATH.RANK
+   (one JSON line each) every `every` seconds by mt_tick, 0 = never */
+void   mt_open(const char *path, int rank, double every, double (*clock)(void));
+double mt_now(void);
+double mt_elapsed(void);          /* since mt_open */
+void   mt_tick(void);
+void   mt_close(void);
+
+static inline int mt_bucket(int64_t v) {
+    int b = 0;
+    while (v > 0 && b < MT_BUCKETS - 1) { v >>= 1; ++b; }
+    return b;
+}
+
+static inline void mt_count(int64_t *a, int tag, int n) { if (tag >= 0 && tag < MT_NTAGS) a[tag] += n; }
+
+static inline void mt_depth(int n) { ++mt.qdepth[mt_bucket(n)]; mt.qdepth_sum += n; }
+
+/* add the time since *since to a latency histogram */
+static inline void mt_latency(int64_t *h, int64_t *sum_ns, double since) {
+    if (since < 0) return;
+    int64_t ns = (int64_t)((mt_now() - since) * 1e9);
+    if (ns < 0) ns = 0;
+    ++h[mt_bucket(ns / 1000)];
+    *sum_ns += ns;
+}
+
+/* close the interval in state `from` that began at *since */
+static inline void mt_state(int64_t *acc, int from, double *since) {
+    double t = mt_now();
+    acc[from] += (int64_t)((t - *since) * 1e9);
+    *since = t;
+}
+
+/* write m, the sum over `ranks` ranks of a run of `elapsed` seconds, to
+   path (NULL = stdout) as JSON, or as Prometheus text if prom */
+void mt_write(const Metrics *m, int ranks, double elapsed, const char *path, int prom);
+
+#endif
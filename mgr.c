@@ -0,0 +1,685 @@
+#include "mgr.h"
+#include "gset.h"
+#include "imap.h"
+#include "metrics.h"
+#include "trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* per-group index: for one group, a heap of the queued requests that
+   accept it, lowest priority on top. entries are (timestamp, rid) copies
+   that go stale when the request leaves the queue; stale ones are dropped
+   as they surface, and the heap is rebuilt once they are the majority. */
+typedef struct { int ts, rid; } GEnt;
+typedef struct {
+    GEnt *h; int n, cap;
+    int live;               /* queued requests accepting the group */
+} GHeap;
+
+static inline int gh_above(GEnt x, GEnt y) { return higher(y.ts, y.rid, x.ts, x.rid); }
+
+static void gh_sift_down(GHeap *h, int i) {
+    GEnt x = h->h[i];
+    while (1) {
+        int c = 2 * i + 1;
+        if (c >= h->n) break;
+        if (c + 1 < h->n && gh_above(h->h[c + 1], h->h[c])) ++c;
+        if (!gh_above(h->h[c], x)) break;
+        h->h[i] = h->h[c];
+        i = c;
+    }
+    h->h[i] = x;
+}
+static void gh_push(GHeap *h, GEnt x) {
+    if (h->n == h->cap) {
+        h->cap = h->cap ? 2 * h->cap : 8;
+        h->h = xrealloc(h->h, h->cap * sizeof(GEnt));
+    }
+    int i = h->n++;
+    while (i > 0 && gh_above(x, h->h[(i - 1) / 2])) { h->h[i] = h->h[(i - 1) / 2]; i = (i - 1) / 2; }
+    h->h[i] = x;
+}
+static void gh_pop(GHeap *h) {
+    h->h[0] = h->h[--h->n];
+    if (h->n) gh_sift_down(h, 0);
+}
+
+/* request queue: growable binary min-heap on (timestamp, rid) with a
+   rid -> slot index, so a requester's entry can be replaced or withdrawn
+   in O(log n). holds at most one request per requester, never drops.
+   group sets travel with their entries, so the queue's memory follows
+   its length, not the number of requesters in the job. every group
+   named by a queued request also has a GHeap, for admission. */
+typedef struct {
+    Msg *a; int n, cap;
+    uint64_t *gs; int gw;   /* group set of slot i at gs + i * gw */
+    uint64_t *tmp;          /* set of the entry being sifted */
+    IMap pos;               /* rid -> heap slot */
+    GHeap *gh; int ngh;     /* group indexes ... */
+    IMap gidx;              /* ... and group -> index */
+} PQueue;
+
+static void pq_init(PQueue *q, int gw) {
+    memset(q, 0, sizeof(*q));
+    q->gw = gw;
+    q->tmp = xrealloc(NULL, gw * sizeof(uint64_t));
+    im_init(&q->pos);
+    im_init(&q->gidx);
+}
+static void pq_free(PQueue *q) {
+    for (int i = 0; i < q->ngh; ++i) free(q->gh[i].h);
+    free(q->gh);
+    im_free(&q->gidx);
+    free(q->a); free(q->gs); free(q->tmp); im_free(&q->pos);
+    memset(q, 0, sizeof(*q));
+}
+
+/* index of group g, NULL if it has none yet and !make */
+static GHeap *pq_group(PQueue *q, int g, int make) {
+    int i = im_get(&q->gidx, (uint32_t)g);
+    if (i >= 0) return &q->gh[i];
+    if (!make) return NULL;
+    q->gh = xrealloc(q->gh, (q->ngh + 1) * sizeof(GHeap));
+    memset(&q->gh[q->ngh], 0, sizeof(GHeap));
+    im_put(&q->gidx, (uint32_t)g, q->ngh);
+    return &q->gh[q->ngh++];
+}
+
+/* empty queue: forget what the group indexes still hold. a recycled
+   queue keeps up to PQ_KEEP_GROUPS of them and none of their storage
+   past PQ_KEEP_GENTS entries, so a spare Res does not pin every group
+   and every backlog it has ever seen. */
+#define PQ_KEEP_GROUPS 16
+#define PQ_KEEP_GENTS  64
+static void pq_reset_groups(PQueue *q) {
+    if (q->ngh > PQ_KEEP_GROUPS) {
+        for (int i = 0; i < q->ngh; ++i) free(q->gh[i].h);
+        free(q->gh);
+        q->gh = NULL; q->ngh = 0;
+        im_free(&q->gidx);
+        return;
+    }
+    for (int i = 0; i < q->ngh; ++i) {
+        GHeap *h = &q->gh[i];
+        if (h->cap > PQ_KEEP_GENTS) { free(h->h); h->h = NULL; h->cap = 0; }
+        h->n = h->live = 0;
+    }
+}
+
+static inline uint64_t *pq_gset(const PQueue *q, int i) { return q->gs + (size_t)i * q->gw; }
+
+static inline int pq_before(const Msg *x, const Msg *y) {
+    return higher(x->timestamp, x->rid, y->timestamp, y->rid);
+}
+static inline void pq_place(PQueue *q, int i, const Msg *m, const uint64_t *gs) {
+    q->a[i] = *m;
+    gs_copy(pq_gset(q, i), gs, q->gw);
+    im_put(&q->pos, (uint32_t)m->rid, i);
+}
+
+static void pq_sift_up(PQueue *q, int i) {
+    Msg m = q->a[i];
+    gs_copy(q->tmp, pq_gset(q, i), q->gw);
+    while (i > 0) {
+        int p = (i - 1) / 2;
+        if (!pq_before(&m, &q->a[p])) break;
+        pq_place(q, i, &q->a[p], pq_gset(q, p));
+        i = p;
+    }
+    pq_place(q, i, &m, q->tmp);
+}
+static void pq_sift_down(PQueue *q, int i) {
+    Msg m = q->a[i];
+    gs_copy(q->tmp, pq_gset(q, i), q->gw);
+    while (1) {
+        int c = 2 * i + 1;
+        if (c >= q->n) break;
+        if (c + 1 < q->n && pq_before(&q->a[c + 1], &q->a[c])) ++c;
+        if (!pq_before(&q->a[c], &m)) break;
+        pq_place(q, i, &q->a[c], pq_gset(q, c));
+        i = c;
+    }
+    pq_place(q, i, &m, q->tmp);
+}
+
+static int pq_find(const PQueue *q, int rid) { return im_get(&q->pos, (uint32_t)rid); }
+
+/* e, from group g's index, is still a queued request for g. a request
+   requeued with the same timestamp may come back with another set */
+static int pq_holds(const PQueue *q, GEnt e, int g) {
+    int i = pq_find(q, e.rid);
+    return i >= 0 && q->a[i].timestamp == e.ts && gs_test(pq_gset(q, i), g);
+}
+
+/* rebuild group g's index when it is mostly stale entries */
+static void pq_compact(PQueue *q, GHeap *h, int g) {
+    int k = 0;
+    for (int i = 0; i < h->n; ++i) if (pq_holds(q, h->h[i], g)) h->h[k++] = h->h[i];
+    h->n = k;
+    for (int i = k / 2 - 1; i >= 0; --i) gh_sift_down(h, i);
+}
+
+/* remove slot i and return its entry (and set, if gs) */
+static Msg pq_take(PQueue *q, int i, uint64_t *gs) {
+    Msg out = q->a[i];
+    if (gs) gs_copy(gs, pq_gset(q, i), q->gw);
+    GS_FOREACH(g, pq_gset(q, i), q->gw) {
+        GHeap *h = pq_group(q, g, 0);
+        if (h) --h->live;
+    }
+    im_del(&q->pos, (uint32_t)out.rid);
+    if (--q->n > i) {
+        pq_place(q, i, &q->a[q->n], pq_gset(q, q->n));
+        if (i > 0 && pq_before(&q->a[i], &q->a[(i - 1) / 2])) pq_sift_up(q, i);
+        else pq_sift_down(q, i);
+    }
+    return out;
+}
+
+/* queue m with group set gs; an older request from the same requester
+   is replaced */
+static void pq_push(PQueue *q, Msg m, const uint64_t *gs) {
+    int i = pq_find(q, m.rid);
+    if (i >= 0) pq_take(q, i, NULL);
+    if (q->n == q->cap) {
+        q->cap = q->cap ? 2 * q->cap : 16;
+        q->a = xrealloc(q->a, q->cap * sizeof(Msg));
+        q->gs = xrealloc(q->gs, (size_t)q->cap * q->gw * sizeof(uint64_t));
+    }
+    pq_place(q, q->n++, &m, gs);
+    pq_sift_up(q, q->n - 1);
+    GS_FOREACH(g, gs, q->gw) {
+        GHeap *h = pq_group(q, g, 1);
+        ++h->live;
+        gh_push(h, (GEnt){ m.timestamp, m.rid });
+        if (h->n > 2 * h->live + 16) pq_compact(q, h, g);
+    }
+}
+
+/* pop the highest-priority request and its set; 0 if empty */
+static int pq_pop(PQueue *q, Msg *out, uint64_t *gs) {
+    if (q->n == 0) return 0;
+    *out = pq_take(q, 0, gs);
+    return 1;
+}
+
+/* withdraw requester's entry; 0 if it had none */
+static int pq_remove(PQueue *q, int rid) {
+    int i = pq_find(q, rid);
+    if (i < 0) return 0;
+    pq_take(q, i, NULL);
+    return 1;
+}
+
+/* dequeue the requests that may join a session locked on group gm by
+   pivot (pivot_ts): compatible and, unless any, not outranking the
+   pivot. they sit on top of gm's index, so this costs O(k log n) for k
+   admitted (plus the stale entries it clears on the way), whatever the
+   queue's length. an entry goes past a request that cannot join exactly
+   when the queue's head is not in gm; with bypass, each such entry
+   counts there and admission stops once it reaches limit */
+static int pq_admit(PQueue *q, int gm, int pivot_ts, int pivot, int any, int *bypass, int limit,
+                    Msg **out, int *cap) {
+    GHeap *h = pq_group(q, gm, 0);
+    int k = 0;
+    while (h && h->n) {
+        GEnt top = h->h[0];
+        if (!pq_holds(q, top, gm)) { gh_pop(h); continue; }
+        if (!any && higher(top.ts, top.rid, pivot_ts, pivot)) break;
+        if (bypass && !gs_test(pq_gset(q, 0), gm)) {
+            if (*bypass >= limit) break;
+            ++*bypass;
+        }
+        gh_pop(h);
+        if (k == *cap) {
+            *cap = *cap ? 2 * *cap : 16;
+            *out = xrealloc(*out, *cap * sizeof(Msg));
+        }
+        (*out)[k++] = pq_take(q, pq_find(q, top.rid), NULL);
+    }
+    return k;
+}
+
+/* the group of set gs that most queued requests accept, -1 if none does */
+static int pq_largest(PQueue *q, const uint64_t *gs) {
+    int best = -1, most = 0;
+    GS_FOREACH(g, gs, q->gw) {
+        GHeap *h = pq_group(q, g, 0);
+        if (h && h->live > most) { most = h->live; best = g; }
+    }
+    return best;
+}
+
+/* requester sets: members plus a rid -> slot index, O(1) add/remove */
+typedef struct {
+    int *m; int n, cap;
+    IMap pos;
+} RankSet;
+
+static void rs_init(RankSet *s) { memset(s, 0, sizeof(*s)); im_init(&s->pos); }
+static void rs_free(RankSet *s) { free(s->m); im_free(&s->pos); memset(s, 0, sizeof(*s)); }
+static int rs_add(RankSet *s, int r) {
+    if (im_get(&s->pos, (uint32_t)r) >= 0) return 0;
+    if (s->n == s->cap) {
+        s->cap = s->cap ? 2 * s->cap : 16;
+        s->m = xrealloc(s->m, s->cap * sizeof(int));
+    }
+    im_put(&s->pos, (uint32_t)r, s->n);
+    s->m[s->n++] = r;
+    return 1;
+}
+static int rs_remove(RankSet *s, int r) {
+    int i = im_get(&s->pos, (uint32_t)r);
+    if (i < 0) return 0;
+    im_del(&s->pos, (uint32_t)r);
+    int last = s->m[--s->n];
+    if (i < s->n) { s->m[i] = last; im_put(&s->pos, (uint32_t)last, i); }
+    return 1;
+}
+static void rs_clear(RankSet *s) {
+    for (int i = 0; i < s->n; ++i) im_del(&s->pos, (uint32_t)s->m[i]);
+    s->n = 0;
+}
+
+/* queue depth and head (manager) */
+static void trace_queue(int mgr, int lamport, const PQueue *q) {
+    if (q->n == 0) TRACE(EV_MGR_QUEUE_EMPTY, lamport, mgr);
+    else TRACE(EV_MGR_QUEUE, lamport, mgr, q->n, q->a[0].rid, q->a[0].timestamp);
+}
+
+/**************************************************************************
+ * per-resource state. a resource has state only while something is going
+ * on at this manager (a queued request, an OK out, a session); idle ones
+ * go back to a free list, so memory follows the active resources.
+ **************************************************************************/
+typedef struct {
+    int res;
+    MState state;
+
+    int gm;
+    int pivot;              /* rid */
+    int pivot_rank;
+    int pivot_ts;
+
+    PQueue queue;
+    Msg ok_sent;            /* request holding our OK ... */
+    uint64_t *ok_gs;        /* ... and its group set, to requeue it */
+    RankSet followers;
+    int revoked;            /* lease mode: REVOKE sent for this session */
+    int bypass;             /* admitted past a request the session cannot take */
+    int fenced;             /* outside holders still in: no OK yet */
+    double since;           /* metrics: in state since, OK sent at, RELEASE at */
+    double ok_t, rel_t;
+} Res;
+
+struct Mgr {
+    const Config *cfg;
+    int rank, gw;
+    int *lamport;
+
+    Res **live; int nlive, lcap;
+    Res **spare; int nspare;
+    IMap index;             /* resource -> slot in live */
+
+    MgrHooks hk;
+    int nfenced;
+
+    Msg *admit; int acap;   /* requests being admitted */
+    Out *out;               /* the current step's sends */
+
+    int queued, busy;       /* requests queued, resources not vacant */
+};
+
+/* what OK/ENTER/CANCEL/FINISHED/REVOKE report to requesters */
+static inline int mgr_load(const Mgr *m) { return m->queued + m->busy; }
+
+static Res *res_get(Mgr *m, int id) {
+    int i = im_get(&m->index, (uint32_t)id);
+    if (i >= 0) return m->live[i];
+
+    Res *r;
+    if (m->nspare) r = m->spare[--m->nspare];
+    else {
+        r = xrealloc(NULL, sizeof(Res));
+        pq_init(&r->queue, m->gw);
+        rs_init(&r->followers);
+        r->ok_gs = xrealloc(NULL, m->gw * sizeof(uint64_t));
+    }
+    r->res = id;
+    r->state = M_VACANT;
+    r->since = mt_now();
+    r->ok_t = r->rel_t = -1;
+    r->gm = -1; r->pivot = -1; r->pivot_rank = -1; r->pivot_ts = -1;
+    r->ok_sent.rid = -1; r->ok_sent.timestamp = -1;
+    r->revoked = 0;
+    r->bypass = 0;
+
+    if (m->nlive == m->lcap) {
+        m->lcap = m->lcap ? 2 * m->lcap : 16;
+        m->live = xrealloc(m->live, m->lcap * sizeof(Res *));
+        m->spare = xrealloc(m->spare, m->lcap * sizeof(Res *));
+    }
+    im_put(&m->index, (uint32_t)id, m->nlive);
+    m->live[m->nlive++] = r;
+    TRACE(EV_MGR_RES_NEW, *m->lamport, m->rank, id, m->nlive);
+
+    int in = m->hk.claim ? m->hk.claim(m->hk.ctx, id) : 0;
+    r->fenced = in > 0;
+    if (in) {
+        ++m->nfenced;
+        TRACE(EV_MGR_FENCE, *m->lamport, m->rank, id, in);
+    }
+    return r;
+}
+
+/* recycle r if nothing is going on there any more */
+static void res_put(Mgr *m, Res *r) {
+    if (r->state != M_VACANT || r->queue.n || r->followers.n) return;
+    mt_state(mt.mstate_ns, r->state, &r->since);
+    pq_reset_groups(&r->queue);
+    if (r->fenced) { r->fenced = 0; --m->nfenced; }
+    if (m->hk.unclaim) m->hk.unclaim(m->hk.ctx, r->res);
+    int i = im_get(&m->index, (uint32_t)r->res);
+    im_del(&m->index, (uint32_t)r->res);
+    Res *last = m->live[--m->nlive];
+    if (i < m->nlive) { m->live[i] = last; im_put(&m->index, (uint32_t)last->res, i); }
+    m->spare[m->nspare++] = r;
+    TRACE(EV_MGR_RES_FREE, *m->lamport, m->rank, r->res, m->nlive);
+}
+
+static void res_free(Res *r) {
+    pq_free(&r->queue);
+    rs_free(&r->followers);
+    free(r->ok_gs);
+    free(r);
+}
+
+/**************************************************************************
+ * state machine - high-detail logging
+ **************************************************************************/
+static inline void res_state(Res *r, MState st) {
+    mt_state(mt.mstate_ns, r->state, &r->since);
+    r->state = st;
+}
+
+/* send the admitted requests their ENTERs, all at one clock */
+static void admit_followers(Res *r, Out *out, const Msg *adm, int an, int rank, int load, int *lamport) {
+    ++*lamport;
+    for (int k = 0; k < an; ++k) {
+        const Msg *e = &adm[k];
+        Msg ent = { e->timestamp, rank, r->gm, 0, 0, e->rid, r->res, load };
+        out_send(out, &ent, e->rank, TAG_ENTER, *lamport);
+        rs_add(&r->followers, e->rid);
+        TRACE(EV_MGR_ENTER, *lamport, rank, e->rid, r->gm, e->timestamp);
+    }
+}
+
+/* vacant: grant our OK to the head of the queue, if any; ev says why.
+   with --admit=largest the OK names the group of the request's set that
+   most requests wait for here, for the pivot to lock */
+static void grant_next(Mgr *m, Res *r, int *lamport, int ev) {
+    Msg sel;
+    if (r->fenced || !pq_pop(&r->queue, &sel, r->ok_gs)) return;
+    r->ok_sent = sel;
+    int g = m->cfg->admit == ADMIT_LARGEST ? pq_largest(&r->queue, r->ok_gs) : -1;
+    Msg ok = { sel.timestamp, m->rank, g, 0, 0, sel.rid, r->res, mgr_load(m) };
+    ++*lamport;
+    out_send(m->out, &ok, sel.rank, TAG_OK, *lamport);
+    TRACE(ev, *lamport, m->rank, sel.rid, sel.timestamp);
+    res_state(r, M_WAITLOCK);
+    r->ok_t = r->since;
+}
+
+/**************************************************************************
+ * admission policy - which queued requests join a locked session
+ *
+ *   fcfs     compatible requests the pivot outranks (the paper's rule):
+ *            nobody is overtaken by a request younger than itself
+ *   batch    every compatible request, whatever its timestamp
+ *   largest  batch, and the pivot locks the group of its set that most
+ *            requests wait for (see grant_next)
+ *
+ * OKs still go out in priority order under every policy: managers that
+ * granted out of order could each hold an OK the other's request needs,
+ * with no newer REQUEST to trigger the CANCEL that breaks the tie. nor
+ * is anyone admitted once the pivot has released: the pivot waits for
+ * its FINISHED, so its next request would pay for the longer session.
+ *
+ * batch and largest bound the bypass: a session admits at most
+ * admit_bypass requests past one it cannot take in, counted one by one
+ * even within a batch, so the blocked request's turn comes after a
+ * bounded number of entries.
+ **************************************************************************/
+static void admit(Mgr *m, Res *r, int *lamport) {
+    int any = m->cfg->admit != ADMIT_FCFS;
+    if (r->state != M_LOCKED) return;
+    int before = r->bypass;
+    int an = pq_admit(&r->queue, r->gm, r->pivot_ts, r->pivot, any, any ? &r->bypass : NULL,
+                      m->cfg->admit_bypass, &m->admit, &m->acap);
+    if (!an) return;
+    if (r->bypass > before) TRACE(EV_MGR_BYPASS, *lamport, m->rank, r->bypass - before, r->bypass);
+    admit_followers(r, m->out, m->admit, an, m->rank, mgr_load(m), lamport);
+}
+
+/* lease mode: a request still queued under a locked session is one the
+   session cannot take in, so the pivot must stop re-entering from its
+   lease; it is told once per session */
+static void revoke_if_blocked(Mgr *m, Res *r, int *lamport) {
+    if (m->cfg->lease <= 0 || r->state != M_LOCKED || r->revoked || !r->queue.n) return;
+    Msg rv = { r->pivot_ts, m->rank, r->gm, 0, 0, r->pivot, r->res, mgr_load(m) };
+    ++*lamport;
+    out_send(m->out, &rv, r->pivot_rank, TAG_REVOKE, *lamport);
+    TRACE(EV_MGR_REVOKE, *lamport, m->rank, r->pivot, r->pivot_ts);
+    r->revoked = 1;
+}
+
+Mgr *mgr_open(const Config *cfg, const Coterie *cot, int rank, int *lamport, const MgrHooks *hk) {
+    Mgr *m = xrealloc(NULL, sizeof(Mgr));
+    memset(m, 0, sizeof(*m));
+    if (hk) m->hk = *hk;
+    m->cfg = cfg;
+    m->rank = rank;
+    m->gw = GSET_WORDS(cfg->ngroups);
+    m->lamport = lamport;
+    im_init(&m->index);
+
+    int member_of = 0;
+    for (int i = 0; i < cot->nq; ++i) {
+        int n; const int *q = cot_quorum(cot, i, &n);
+        for (int k = 0; k < n; ++k) if (q[k] == rank) { ++member_of; break; }
+    }
+    TRACE(EV_MGR_START, *lamport, rank, member_of, cot->nq);
+    return m;
+}
+
+int mgr_active(const Mgr *m) { return m->nlive; }
+int mgr_fenced(const Mgr *m) { return m->nfenced; }
+
+void mgr_poll(Mgr *m, Out *out) {
+    if (!m->nfenced) return;
+    m->out = out;
+    int lamport = *m->lamport;
+    for (int i = 0; i < m->nlive; ++i) {
+        Res *r = m->live[i];
+        if (!r->fenced || m->hk.holders(m->hk.ctx, r->res) > 0) continue;
+        r->fenced = 0;
+        --m->nfenced;
+        TRACE(EV_MGR_UNFENCE, lamport, m->rank, r->res);
+        int queued = r->queue.n, busy = r->state != M_VACANT;
+        if (r->state == M_VACANT) grant_next(m, r, &lamport, EV_MGR_OK_FENCE);
+        m->queued += r->queue.n - queued;
+        m->busy += (r->state != M_VACANT) - busy;
+    }
+    *m->lamport = lamport;
+}
+
+void mgr_close(Mgr *m) {
+    TRACE(EV_MGR_EXIT, *m->lamport, m->rank);
+    for (int i = 0; i < m->nlive; ++i) {
+        mt_state(mt.mstate_ns, m->live[i]->state, &m->live[i]->since);
+        res_free(m->live[i]);
+    }
+    for (int i = 0; i < m->nspare; ++i) res_free(m->spare[i]);
+    free(m->live);
+    free(m->spare);
+    im_free(&m->index);
+    free(m->admit);
+    free(m);
+}
+
+void mgr_on_msg(Mgr *m, const Msg *in, const uint64_t *mgs, int tag, int src, Out *out) {
+    Msg msg = *in;
+    m->out = out;
+    int rank = m->rank, gw = m->gw;
+    int lamport = *m->lamport = max2(*m->lamport, msg.clock) + 1;
+    mt_count(mt.recv, tag, 1);
+
+    if (tag < TAG_REQUEST || tag > TAG_OVER) {
+        TRACE(EV_MGR_UNKNOWN, lamport, rank, tag, src);
+        return;
+    }
+    Res *r = res_get(m, msg.res);
+    int queued = r->queue.n, busy = r->state != M_VACANT;
+
+    /* detailed receipt log */
+    TRACE(EV_MGR_RECV, lamport, rank, tag, src, msg.res, msg.timestamp, TR_GS(mgs, gw), r->state);
+
+    switch (tag) {
+
+        case TAG_REQUEST: {
+            /* insert (replacing any older request of this requester) and log queue */
+            pq_push(&r->queue, msg, mgs);
+            TRACE(EV_MGR_INSERT, lamport, rank, msg.rid, msg.timestamp, r->queue.n);
+            mt_depth(r->queue.n);
+            trace_queue(rank, lamport, &r->queue);
+
+            /* vacancy -> send OK to highest priority */
+            if (r->state == M_VACANT) grant_next(m, r, &lamport, EV_MGR_OK);
+            /* waitlock cancellation check */
+            else if (r->state == M_WAITLOCK && r->ok_sent.rid >= 0) {
+                if (higher(msg.timestamp, msg.rid, r->ok_sent.timestamp, r->ok_sent.rid)) {
+                    Msg c = { r->ok_sent.timestamp, rank, -1, 0, 0, r->ok_sent.rid, r->res, mgr_load(m) };
+                    ++lamport;
+                    out_send(out, &c, r->ok_sent.rank, TAG_CANCEL, lamport);
+                    TRACE(EV_MGR_CANCEL, lamport, rank, r->ok_sent.rid, r->ok_sent.timestamp);
+                    res_state(r, M_WAITCANCEL);
+                }
+            }
+
+            /* if locked, the new request may join right away, or else
+               end the pivot's lease */
+            admit(m, r, &lamport);
+            revoke_if_blocked(m, r, &lamport);
+            break;
+        }
+
+        case TAG_LOCK: {
+            /* pivot announces lock */
+            r->gm = msg.group;
+            r->pivot = msg.rid; r->pivot_rank = msg.rank; r->pivot_ts = msg.timestamp;
+            if (r->ok_sent.rid == msg.rid) mt_latency(mt.ok_lock, &mt.ok_lock_ns, r->ok_t);
+            r->ok_sent.rid = -1;
+            res_state(r, M_LOCKED);
+            r->revoked = 0;
+            r->bypass = 0;
+            rs_clear(&r->followers);
+
+            TRACE(EV_MGR_LOCK, lamport, rank, r->pivot, r->gm, r->pivot_ts);
+            trace_queue(rank, lamport, &r->queue);
+
+            /* send ENTER to queued compatible requests */
+            admit(m, r, &lamport);
+            revoke_if_blocked(m, r, &lamport);
+            trace_queue(rank, lamport, &r->queue);
+            break;
+        }
+
+        case TAG_RELEASE: {
+            if (msg.rid == r->pivot && msg.timestamp == r->pivot_ts) {
+                /* pivot begins releasing */
+                res_state(r, M_RELEASING);
+                r->rel_t = r->since;
+                TRACE(EV_MGR_RELEASE, lamport, rank, r->pivot, r->pivot_ts);
+            } else if (rs_remove(&r->followers, msg.rid)) {
+                /* follower left the CS */
+                TRACE(EV_MGR_FOLLOWER_OUT, lamport, rank, msg.rid, r->followers.n);
+            } else {
+                TRACE(EV_MGR_STRAY_REL, lamport, rank, msg.rid);
+                ++mt.stray;
+                break;
+            }
+
+            if (r->state == M_RELEASING && r->followers.n == 0) {
+                Msg fin = { r->pivot_ts, rank, -1, 0, 0, r->pivot, r->res, mgr_load(m) };
+                ++lamport;
+                out_send(out, &fin, r->pivot_rank, TAG_FINISHED, lamport);
+                TRACE(EV_MGR_FINISHED, lamport, rank, r->pivot, r->pivot_ts);
+            }
+            break;
+        }
+
+        case TAG_NONEED: {
+            /* follower was admitted elsewhere; it stays a follower
+               until its RELEASE */
+            TRACE(EV_MGR_NONEED, lamport, rank, msg.rid, msg.timestamp);
+
+            /* withdraw the request it no longer needs */
+            int qi = pq_find(&r->queue, msg.rid);
+            if (qi >= 0 && r->queue.a[qi].timestamp <= msg.timestamp) {
+                pq_remove(&r->queue, msg.rid);
+                TRACE(EV_MGR_WITHDRAW, lamport, rank, msg.rid, r->queue.n);
+            }
+
+            /* the OK we gave (or are cancelling) is no longer wanted */
+            if ((r->state == M_WAITLOCK || r->state == M_WAITCANCEL) &&
+                r->ok_sent.rid == msg.rid && r->ok_sent.timestamp == msg.timestamp) {
+                r->ok_sent.rid = -1;
+                res_state(r, M_VACANT);
+                TRACE(EV_MGR_NONEED_OK, lamport, rank);
+                grant_next(m, r, &lamport, EV_MGR_OK_NONEED);
+            }
+            break;
+        }
+
+        case TAG_CANCELLED: {
+            TRACE(EV_MGR_CANCELLED, lamport, rank, msg.rid);
+            if (r->state == M_WAITCANCEL && r->ok_sent.rid == msg.rid) {
+                /* revoked request goes back into the queue */
+                pq_push(&r->queue, r->ok_sent, r->ok_gs);
+                r->ok_sent.rid = -1;
+                res_state(r, M_VACANT);
+                grant_next(m, r, &lamport, EV_MGR_OK_CANCELLED);
+            }
+            break;
+        }
+
+        case TAG_FINISHED: {
+            /* unexpected for manager but log */
+            TRACE(EV_MGR_STRAY_FIN, lamport, rank, src);
+            ++mt.stray;
+            break;
+        }
+
+        case TAG_OVER: {
+            /* pivot completed cycle and informs managers */
+            mt_latency(mt.rel_over, &mt.rel_over_ns, r->rel_t);
+            r->rel_t = -1;
+            res_state(r, M_VACANT);
+            r->gm = -1; r->pivot = -1; r->pivot_rank = -1; r->pivot_ts = -1;
+            rs_clear(&r->followers);
+            TRACE(EV_MGR_OVER, lamport, rank);
+            grant_next(m, r, &lamport, EV_MGR_OK_OVER);
+            break;
+        }
+
+        default:
+            TRACE(EV_MGR_UNKNOWN, lamport, rank, tag, src);
+            break;
+    }
+
+    *m->lamport = lamport;
+    m->queued += r->queue.n - queued;
+    m->busy += (r->state != M_VACANT) - busy;
+    res_put(m, r);
+}
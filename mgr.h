@@ -0,0 +1,53 @@
+#ifndef MGR_H
+#define MGR_H
+
+/**************************************************************************
+ * mgr - the manager state machine
+ *
+ * one Mgr per manager rank, fed every message addressed to the manager
+ * role (REQUEST, LOCK, RELEASE, NONEED, CANCELLED, OVER) by
+ * whichever loop owns the rank's receives: manager_role on a dedicated
+ * manager rank, the requester's progress loop in symmetric mode, or the
+ * simulator. a step only appends the messages it sends to an Out; the
+ * driver delivers them.
+ *
+ * each resource named by a message runs its own instance of the state
+ * machine; see mgr.c for how per-resource state is kept.
+ **************************************************************************/
+#include <stdint.h>
+
+#include "config.h"
+#include "coterie.h"
+#include "wire.h"
+
+typedef struct Mgr Mgr;
+
+/* requesters that hold a resource without this manager's protocol (the
+   RMA fast path): it must not grant the resource until they are out */
+typedef struct {
+    /* res became active here / idle again; claim returns the holders in */
+    int  (*claim)(void *ctx, int res);
+    void (*unclaim)(void *ctx, int res);
+    int  (*holders)(void *ctx, int res);
+    void *ctx;
+} MgrHooks;
+
+/* lamport is the rank's Lamport clock, shared with a co-located
+   requester; hk may be NULL */
+Mgr *mgr_open(const Config *cfg, const Coterie *cot, int rank, int *lamport, const MgrHooks *hk);
+void mgr_on_msg(Mgr *m, const Msg *msg, const uint64_t *gs, int tag, int src, Out *out);
+/* resources with a session, request or follower still live here */
+int  mgr_active(const Mgr *m);
+/* resources waiting for outside holders to leave; mgr_poll grants the
+   ones they have left */
+int  mgr_fenced(const Mgr *m);
+void mgr_poll(Mgr *m, Out *out);
+void mgr_close(Mgr *m);
+
+/* tags the manager role handles */
+static inline int mgr_tag(int tag) {
+    return tag == TAG_REQUEST || tag == TAG_LOCK || tag == TAG_RELEASE || tag == TAG_NONEED ||
+           tag == TAG_CANCELLED || tag == TAG_OVER;
+}
+
+#endif
@@ -0,0 +1,417 @@
+#include "proto.h"
+#include "gset.h"
+#include "metrics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+long n_sent, n_recv, n_local;
+
+static Progress *lb_pe;
+static int lb_rank = -1;
+
+/* queue a copy of a message for this rank itself */
+static void lb_push(const void *buf, int len, int tag, int clock) {
+    Progress *pe = lb_pe;
+    if (pe->ln == pe->lcap) {
+        /* grow and unwrap the ring */
+        int cap = pe->lcap ? 2 * pe->lcap : 16;
+        unsigned char *b = xrealloc(NULL, cap * pe->slot);
+        int *t = xrealloc(NULL, cap * sizeof(int));
+        for (int i = 0; i < pe->ln; ++i) {
+            int k = (pe->lhead + i) % pe->lcap;
+            memcpy(b + i * pe->slot, pe->lbuf + k * pe->slot, pe->slot);
+            t[i] = pe->ltag[k];
+        }
+        free(pe->lbuf); free(pe->ltag);
+        pe->lbuf = b; pe->ltag = t; pe->lcap = cap; pe->lhead = 0;
+    }
+    int k = (pe->lhead + pe->ln++) % pe->lcap;
+    unsigned char *p = pe->lbuf + k * pe->slot;
+    memcpy(p, buf, (size_t)len < pe->slot ? (size_t)len : pe->slot);
+    ((Msg *)p)->clock = clock;
+    pe->ltag[k] = tag;
+}
+
+static int lb_self(int dst) { return lb_pe && dst == lb_rank; }
+
+void *xrealloc(void *p, size_t sz) {
+    void *q = realloc(p, sz);
+    if (!q && sz) { fprintf(stderr, "out of memory\n"); MPI_Abort(MPI_COMM_WORLD, 1); }
+    return q;
+}
+
+void hold_until(double t) {
+    double left;
+    while ((left = t - MPI_Wtime()) > 0)
+        if (left > 200e-6) usleep((useconds_t)((left - 100e-6) * 1e6));
+}
+
+/* progress engine */
+
+void pe_init(Progress *pe, int gw) {
+    pe->gw = gw;
+    pe->slot = sizeof(Msg) + (size_t)gw * sizeof(uint64_t);
+    pe->buf = xrealloc(NULL, PE_DEPTH * pe->slot);
+    for (int i = 0; i < PE_DEPTH; ++i)
+        MPI_Recv_init(pe->buf + i * pe->slot, (int)pe->slot, MPI_BYTE, MPI_ANY_SOURCE, MPI_ANY_TAG,
+                      MPI_COMM_WORLD, &pe->req[i]);
+    MPI_Startall(PE_DEPTH, pe->req);
+    pe->head = 0;
+    pe->ready = 0;
+    pe->also = NULL;
+    pe->lbuf = NULL; pe->ltag = NULL;
+    pe->lhead = pe->ln = pe->lcap = 0;
+}
+
+void pe_loopback(Progress *pe, int rank) { lb_pe = pe; lb_rank = rank; }
+void pe_wake_on(Progress *pe, MPI_Request *r) { pe->also = r; }
+
+/* header and zero-filled group set of the message in slot p */
+static void pe_unpack(const Progress *pe, const unsigned char *p, Msg *out, uint64_t *gs) {
+    memcpy(out, p, sizeof(Msg));
+    int nw = out->nwords < pe->gw ? out->nwords : pe->gw;
+    if (nw < 0) nw = 0;
+    memcpy(gs, p + sizeof(Msg), (size_t)nw * sizeof(uint64_t));
+    gs_zero(gs + nw, pe->gw - nw);
+}
+
+int pe_next(Progress *pe, Msg *out, uint64_t *gs, MPI_Status *st) {
+    if (pe->ln) {
+        int k = pe->lhead;
+        pe_unpack(pe, pe->lbuf + k * pe->slot, out, gs);
+        st->MPI_SOURCE = lb_rank;
+        st->MPI_TAG = pe->ltag[k];
+        st->MPI_ERROR = MPI_SUCCESS;
+        pe->lhead = (pe->lhead + 1) % pe->lcap;
+        --pe->ln;
+        return 1;
+    }
+    if (!pe->ready) {
+        int flag = 0;
+        MPI_Test(&pe->req[pe->head], &flag, &pe->head_st);
+        if (!flag) return 0;
+    }
+    pe_unpack(pe, pe->buf + pe->head * pe->slot, out, gs);
+    *st = pe->head_st;
+    if (st->MPI_TAG < TAG_APP_ACQUIRE) ++n_recv;
+    MPI_Start(&pe->req[pe->head]);
+    pe->head = (pe->head + 1) % PE_DEPTH;
+    pe->ready = 0;
+    return 1;
+}
+
+int pe_wait(Progress *pe, double deadline) {
+    if (pe->ready || pe->ln) return 1;
+    int also = pe->also && *pe->also != MPI_REQUEST_NULL;
+    if (deadline < 0) {
+        if (!also) {
+            MPI_Wait(&pe->req[pe->head], &pe->head_st);
+            pe->ready = 1;
+            return 1;
+        }
+        MPI_Request r[2] = { pe->req[pe->head], *pe->also };
+        int i;
+        MPI_Waitany(2, r, &i, &pe->head_st);
+        if (i == 0) pe->ready = 1;
+        else *pe->also = r[1];
+        return 1;
+    }
+    double spin_end = MPI_Wtime() + PE_SPIN_SEC;
+    useconds_t nap = 1;
+    while (1) {
+        int flag = 0;
+        MPI_Test(&pe->req[pe->head], &flag, &pe->head_st);
+        if (flag) { pe->ready = 1; return 1; }
+        if (also) {
+            MPI_Test(pe->also, &flag, MPI_STATUS_IGNORE);
+            if (flag) return 1;
+        }
+        double now = MPI_Wtime();
+        if (now >= deadline) return 0;
+        if (now < spin_end) continue;
+        double left = (deadline - now) * 1e6;
+        usleep(nap < left ? nap : (useconds_t)left + 1);
+        if (nap < PE_NAP_MAX) nap *= 2;
+    }
+}
+
+void pe_free(Progress *pe) {
+    for (int i = 0; i < PE_DEPTH; ++i) {
+        if (!(pe->ready && i == pe->head)) {
+            MPI_Cancel(&pe->req[i]);
+            MPI_Wait(&pe->req[i], MPI_STATUS_IGNORE);
+        }
+        MPI_Request_free(&pe->req[i]);
+    }
+    free(pe->buf);
+    free(pe->lbuf); free(pe->ltag);
+    if (lb_pe == pe) { lb_pe = NULL; lb_rank = -1; }
+}
+
+/* fan-out */
+
+void fo_init(Fanout *f) { memset(f, 0, sizeof(*f)); out_init(&f->fly); }
+
+void fo_wait(Fanout *f) {
+    if (f->nreq) MPI_Waitall(f->nreq, f->req, MPI_STATUSES_IGNORE);
+    f->nreq = 0;
+}
+
+void fo_free(Fanout *f) { fo_wait(f); free(f->req); out_free(&f->fly); memset(f, 0, sizeof(*f)); }
+
+void fo_post(Fanout *f, Out *o) {
+    if (!o->n) return;
+
+    /* the previous batch is done with: its buffers become o's */
+    fo_wait(f);
+    Out done = f->fly;
+    f->fly = *o;
+    *o = done;
+    out_clear(o);
+
+    const Out *b = &f->fly;
+    if (b->n > f->rcap) { f->rcap = b->n; f->req = xrealloc(f->req, f->rcap * sizeof(MPI_Request)); }
+    int k = 0;
+    for (int i = 0; i < b->n; ++i) {
+        const OutMsg *e = &b->m[i];
+        const void *p = out_bytes(b, i);
+        if (lb_self(e->dst)) { lb_push(p, e->len, e->tag, ((const Msg *)p)->clock); ++n_local; continue; }
+        MPI_Isend(p, e->len, MPI_BYTE, e->dst, e->tag, MPI_COMM_WORLD, &f->req[k++]);
+    }
+    f->nreq = k;
+    n_sent += k;
+}
+
+/* termination detection */
+
+void td_init(Term *t) {
+    memset(t, 0, sizeof(*t));
+    MPI_Comm_dup(MPI_COMM_WORLD, &t->comm);
+    t->req = MPI_REQUEST_NULL;
+    t->last[0] = t->last[1] = -1;
+}
+
+int td_poll(Term *t) {
+    if (t->over) return 1;
+    if (t->waves) {
+        int flag;
+        MPI_Test(&t->req, &flag, MPI_STATUS_IGNORE);
+        if (!flag) return 0;
+        if (t->sum[0] == t->sum[1] && t->sum[0] == t->last[0] && t->sum[1] == t->last[1]) {
+            t->over = 1;
+            return 1;
+        }
+        t->last[0] = t->sum[0];
+        t->last[1] = t->sum[1];
+    }
+    t->mine[0] = n_sent;
+    t->mine[1] = n_recv;
+    MPI_Iallreduce(t->mine, t->sum, 2, MPI_LONG, MPI_SUM, t->comm, &t->req);
+    ++t->waves;
+    return 0;
+}
+
+void td_free(Term *t) {
+    if (t->req != MPI_REQUEST_NULL) MPI_Wait(&t->req, MPI_STATUS_IGNORE);
+    MPI_Comm_free(&t->comm);
+}
+
+/* fast path */
+
+void fp_init(Fast *f, int on, int words) {
+    memset(f, 0, sizeof(*f));
+    f->on = on;
+    if (!on) return;
+    MPI_Comm_rank(MPI_COMM_WORLD, &f->rank);
+    MPI_Win_allocate((MPI_Aint)words * sizeof(int64_t), sizeof(int64_t), MPI_INFO_NULL, MPI_COMM_WORLD,
+                     &f->base, &f->win);
+    MPI_Win_lock_all(0, f->win);
+    if (words) {
+        memset(f->base, 0, (size_t)words * sizeof(int64_t));
+        f->claims = xrealloc(NULL, FP_SLOTS * sizeof(int));
+        memset(f->claims, 0, FP_SLOTS * sizeof(int));
+    }
+    MPI_Win_sync(f->win);
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+void fp_free(Fast *f) {
+    if (!f->on) return;
+    MPI_Win_unlock_all(f->win);
+    MPI_Win_free(&f->win);
+    free(f->claims);
+    memset(f, 0, sizeof(*f));
+}
+
+static inline int fp_slot(int res) { return (int)((unsigned)res % FP_SLOTS); }
+
+/* the word's old value; swapped in only if it was cmp */
+static int64_t fp_cas(Fast *f, int rank, int slot, int64_t cmp, int64_t val) {
+    int64_t old;
+    MPI_Compare_and_swap(&val, &cmp, &old, MPI_INT64_T, rank, slot, f->win);
+    MPI_Win_flush(rank, f->win);
+    return old;
+}
+
+/* a value no word ever holds, to read with a CAS that never matches */
+#define FP_NEVER (-1LL)
+
+int fp_acquire(Fast *f, const int *q, int qn, int res, const uint64_t *gs, int gw, int64_t *held) {
+    int slot = fp_slot(res), group = -1, k;
+    if (gs_first(gs, gw) < 0) return -1;
+    for (k = 0; k < qn; ++k) {
+        /* guess the word free; a failed CAS tells us what it is */
+        int64_t w = 0, nw = 0;
+        int ok = 0;
+        for (int t = 0; t < FP_TRIES && !ok; ++t) {
+            int wg = FP_GROUP(w);
+            if (w & FP_CLOSED) break;
+            if (FP_COUNT(w) == 0) nw = FP_WORD(group >= 0 ? group : gs_first(gs, gw), 1);
+            else if (gs_test(gs, wg) && (group < 0 || group == wg)) nw = w + 1;
+            else break;
+            int64_t old = fp_cas(f, q[k], slot, w, nw);
+            ok = old == w;
+            w = old;
+        }
+        if (!ok) break;
+        held[k] = nw;
+        group = FP_GROUP(nw);
+    }
+    if (k == qn) return group;
+    fp_release(f, q, k, res, held);
+    return -1;
+}
+
+void fp_release(Fast *f, const int *q, int qn, int res, const int64_t *held) {
+    int slot = fp_slot(res);
+    for (int k = 0; k < qn; ++k) {
+        /* the last one out leaves the word free (or just closed) */
+        int64_t w = held[k], old;
+        while ((old = fp_cas(f, q[k], slot, w, FP_COUNT(w) == 1 ? w & FP_CLOSED : w - 1)) != w) w = old;
+    }
+}
+
+/* manager hooks: res is active at this manager's protocol / idle again */
+static int fp_holders(void *ctx, int res) {
+    Fast *f = ctx;
+    return FP_COUNT(fp_cas(f, f->rank, fp_slot(res), FP_NEVER, FP_NEVER));
+}
+
+static int fp_claim(void *ctx, int res) {
+    Fast *f = ctx;
+    int slot = fp_slot(res);
+    if (f->claims[slot]++) return fp_holders(f, res);
+    int64_t w = 0, old;
+    while ((old = fp_cas(f, f->rank, slot, w, w | FP_CLOSED)) != w) w = old;
+    return FP_COUNT(w);
+}
+
+static void fp_unclaim(void *ctx, int res) {
+    Fast *f = ctx;
+    int slot = fp_slot(res);
+    if (--f->claims[slot]) return;
+    int64_t w = FP_CLOSED, old;
+    while ((old = fp_cas(f, f->rank, slot, w, w & ~FP_CLOSED)) != w) w = old;
+}
+
+MgrHooks fp_mgr_hooks(Fast *f) {
+    MgrHooks hk = { fp_claim, fp_unclaim, fp_holders, f };
+    return hk;
+}
+
+/* cohort */
+
+void co_init(Cohort *c, int on) {
+    memset(c, 0, sizeof(*c));
+    c->on = on;
+    if (!on) return;
+    int wrank, n;
+    MPI_Comm_rank(MPI_COMM_WORLD, &wrank);
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &c->node);
+    MPI_Comm_rank(c->node, &c->me);
+    MPI_Comm_size(c->node, &n);
+    c->world = xrealloc(NULL, n * sizeof(int));
+    MPI_Allgather(&wrank, 1, MPI_INT, c->world, 1, MPI_INT, c->node);
+
+    void *base;
+    MPI_Aint size = c->me == 0 ? CO_SLOTS * sizeof(uint64_t) : 0;
+    int disp;
+    MPI_Win_allocate_shared(size, sizeof(uint64_t), MPI_INFO_NULL, c->node, &base, &c->win);
+    MPI_Win_shared_query(c->win, 0, &size, &disp, &base);
+    c->w = base;
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, c->win);
+    if (c->me == 0)
+        for (int i = 0; i < CO_SLOTS; ++i) atomic_init(&c->w[i], 0);
+    MPI_Win_sync(c->win);
+    MPI_Barrier(c->node);
+    MPI_Win_sync(c->win);
+}
+
+void co_free(Cohort *c) {
+    if (!c->on) return;
+    MPI_Win_unlock_all(c->win);
+    MPI_Win_free(&c->win);
+    MPI_Comm_free(&c->node);
+    free(c->world);
+    memset(c, 0, sizeof(*c));
+}
+
+int co_join(Cohort *c, int res, const uint64_t *gs, int max) {
+    if (res < 0 || res >= CO_SLOTS) return -1;
+    _Atomic uint64_t *p = &c->w[res];
+    uint64_t w = atomic_load(p);
+    do {
+        if (CO_STATE(w) != CO_HELD || CO_JOINS(w) >= max || CO_COUNT(w) == 0xffff ||
+            !gs_test(gs, CO_GROUP(w)))
+            return -1;
+    } while (!atomic_compare_exchange_weak(p, &w, w + (1ULL << 16) + 1));
+    return CO_GROUP(w);
+}
+
+int co_lead(Cohort *c, int res) {
+    if (res < 0 || res >= CO_SLOTS) return 0;
+    uint64_t w = 0;
+    return atomic_compare_exchange_strong(&c->w[res], &w, CO_WORD(CO_PENDING, -1, c->me, 0, 1));
+}
+
+/* a pending word is only ever changed by its leader */
+void co_held(Cohort *c, int res, int group) { atomic_store(&c->w[res], CO_WORD(CO_HELD, group, c->me, 0, 1)); }
+void co_abandon(Cohort *c, int res) { atomic_store(&c->w[res], 0); }
+
+int co_leave(Cohort *c, int res) {
+    uint64_t w = atomic_fetch_sub(&c->w[res], 1);
+    return CO_COUNT(w) == 1 ? c->world[CO_OWNER(w)] : -1;
+}
+
+int co_end(Cohort *c, int res) {
+    uint64_t w = atomic_load(&c->w[res]);
+    if (CO_STATE(w) != CO_HELD || CO_COUNT(w) || CO_OWNER(w) != c->me) return 0;
+    return atomic_compare_exchange_strong(&c->w[res], &w, 0);
+}
+
+/* hierarchy */
+
+int node_sub(int requester, int *nlocal) {
+    int wrank, n;
+    MPI_Comm node;
+    MPI_Comm_rank(MPI_COMM_WORLD, &wrank);
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node);
+    MPI_Comm_size(node, &n);
+    int *all = xrealloc(NULL, n * sizeof(int));
+    int mine = requester ? wrank : -1;
+    MPI_Allgather(&mine, 1, MPI_INT, all, 1, MPI_INT, node);
+    MPI_Comm_free(&node);
+
+    int sub = -1;
+    *nlocal = 0;
+    for (int i = 0; i < n; ++i) {
+        if (all[i] < 0) continue;
+        ++*nlocal;
+        if (sub < 0 || all[i] < sub) sub = all[i];
+    }
+    free(all);
+    return sub;
+}
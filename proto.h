@@ -0,0 +1,220 @@
+#ifndef PROTO_H
+#define PROTO_H
+
+/**************************************************************************
+ * proto - MPI transport shared by managers and requesters
+ *
+ *   Progress  ring of pre-posted persistent receives
+ *   Fanout    nonblocking sends of one batch of messages
+ *   Term      detection of the end of the job
+ *   Fast      one-sided acquisition through RMA state words
+ *   Cohort    node-local sharing of a grant through shared memory
+ *   node_sub  where a node's sub-manager runs
+ **************************************************************************/
+#include <mpi.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mgr.h"
+#include "wire.h"
+
+/* protocol messages: n_sent and n_recv over MPI, n_local delivered in
+   memory by the loopback */
+extern long n_sent, n_recv, n_local;
+
+/* wait until time t; the last stretch is spun so short holds stay short */
+void hold_until(double t);
+
+/**************************************************************************
+ * progress engine - ring of pre-posted persistent receives
+ *
+ * MPI matches wildcard receives in posting order, so the ring head is
+ * always the next message to arrive; draining from the head keeps the
+ * per-sender FIFO order the protocol relies on.
+ **************************************************************************/
+#define PE_DEPTH    64
+#define PE_SPIN_SEC 50e-6   /* busy-test window before backing off */
+#define PE_NAP_MAX  500     /* longest backoff nap (usec) on timed waits */
+
+typedef struct {
+    MPI_Request req[PE_DEPTH];
+    unsigned char *buf;     /* PE_DEPTH slots of header + gw words */
+    size_t slot;
+    int gw;
+    MPI_Status head_st;
+    int head;
+    int ready;              /* head completed but not consumed yet */
+    MPI_Request *also;      /* pe_wait also returns when this completes */
+    /* loopback: messages the rank sent itself, in send order */
+    unsigned char *lbuf; int *ltag;
+    int lhead, ln, lcap;
+} Progress;
+
+void pe_init(Progress *pe, int gw);
+/* take the next arrived message without blocking; 0 if none pending.
+   the group-set payload (if any) lands in gs, zero-filled to gw words */
+int  pe_next(Progress *pe, Msg *out, uint64_t *gs, MPI_Status *st);
+/* block until a message is pending (or pe_wake_on's request is done);
+   deadline < 0 waits forever. returns 0 if the deadline passed first */
+int  pe_wait(Progress *pe, double deadline);
+void pe_wake_on(Progress *pe, MPI_Request *r);
+void pe_free(Progress *pe);
+/* symmetric mode: messages this rank sends itself are queued on pe and
+   handed out by pe_next (before MPI arrivals) without touching MPI */
+void pe_loopback(Progress *pe, int rank);
+
+/**************************************************************************
+ * fan-out - nonblocking sends of one batch of messages
+ *
+ * a step's Out is posted as one batch of MPI_Isends and left in flight
+ * while the caller goes back to its progress loop; its buffers are only
+ * reused (and the batch waited for) when the next batch is posted. MPI
+ * keeps per-destination order between these and blocking sends.
+ **************************************************************************/
+typedef struct {
+    MPI_Request *req; int nreq, rcap;
+    Out fly;                /* the batch in flight */
+} Fanout;
+
+void fo_init(Fanout *f);
+void fo_wait(Fanout *f);
+void fo_free(Fanout *f);
+/* send everything in o and leave o empty */
+void fo_post(Fanout *f, Out *o);
+
+/**************************************************************************
+ * termination detection - waves of a nonblocking allreduce
+ *
+ * a rank joins once its own work is over: a requester when it has
+ * closed, a manager from the start, as it only ever answers. each wave
+ * sums the protocol messages sent and received over MPI so far; two
+ * waves in a row with sent == received and the same totals mean nothing
+ * was in flight in between, so the job is over (the four-counter
+ * method). every rank sees the same sums and stops after the same wave,
+ * with no message left unreceived.
+ **************************************************************************/
+typedef struct {
+    MPI_Comm comm;
+    MPI_Request req;        /* the wave in progress */
+    long mine[2], sum[2];   /* sent, received */
+    long last[2];           /* sums of the previous wave */
+    int waves, over;
+} Term;
+
+/* collective over MPI_COMM_WORLD, like td_free */
+void td_init(Term *t);
+/* the rank is passive (nothing queued for it to handle): start a wave
+   or collect the current one. 1 once the job is over */
+int  td_poll(Term *t);
+void td_free(Term *t);
+
+/**************************************************************************
+ * fast path - one-sided acquisition through RMA state words
+ *
+ * every manager exposes FP_SLOTS words in a window, resource res in slot
+ * res mod FP_SLOTS. a word counts the requesters that hold the slot
+ * without the manager knowing, and the group they hold it for:
+ *   0                 free
+ *   FP_WORD(g, n)     n fast holders in group g; g + 1 takes bits 32-61,
+ *                     so cfg_check keeps groups below 0x3fffffff
+ *   FP_CLOSED | ...   the manager's message protocol runs the slot; the
+ *                     holders still counted are draining, no one joins
+ * a requester holds a resource once it has counted itself in at every
+ * member of a quorum; the manager closes the slot before its protocol
+ * grants anything there, and holds its OK until the count drains. any
+ * quorum meets any other in a manager, whose word admits one side only.
+ * resources sharing a slot only make this more conservative.
+ *
+ * every update is a compare-and-swap (reads too), so the window never
+ * mixes atomic ops; each one is flushed, a round trip. an uncontended
+ * acquire or release costs one per quorum member.
+ **************************************************************************/
+#define FP_SLOTS    1024
+#define FP_TRIES    4                   /* CAS retries per member on a race */
+#define FP_POLL_SEC 20e-6               /* manager: recheck draining holders */
+#define FP_CLOSED   (1LL << 62)
+#define FP_WORD(g, n) ((((int64_t)(g) + 1) << 32) | (int64_t)(n))
+#define FP_COUNT(w) ((int)((w) & 0xffffffff))
+#define FP_GROUP(w) ((int)(((w) >> 32) & 0x3fffffff) - 1)
+
+typedef struct {
+    int on;
+    MPI_Win win;
+    int rank;
+    int64_t *base;          /* this rank's words (managers only) */
+    int *claims;            /* manager: resources of its own holding each slot */
+} Fast;
+
+/* collective over MPI_COMM_WORLD (a no-op unless on), like fp_free */
+void fp_init(Fast *f, int on, int words);
+void fp_free(Fast *f);
+/* requester: count in at every member of quorum q for one group of gs,
+   recording the words written in held[]; the group, or -1 (nothing held) */
+int  fp_acquire(Fast *f, const int *q, int qn, int res, const uint64_t *gs, int gw, int64_t *held);
+/* count out of the first qn members of q */
+void fp_release(Fast *f, const int *q, int qn, int res, const int64_t *held);
+/* manager: the MgrHooks that close and reopen this rank's own words */
+MgrHooks fp_mgr_hooks(Fast *f);
+
+/**************************************************************************
+ * cohort - node-local sharing of a grant through shared memory
+ *
+ * the ranks of a node share CO_SLOTS words, resource res in slot res
+ * (resources from CO_SLOTS up are never shared). a word names the one
+ * request of the node that goes to the managers for the resource, the
+ * leader, and counts the holders inside on its grant:
+ *   0                          free
+ *   CO_PENDING | owner | 1     the leader asked, nothing granted yet
+ *   CO_HELD | g | owner | n    granted for group g, n holders in
+ * a request of another rank on the node for a group of its set joins a
+ * held word without sending anything; the leader keeps its own grant
+ * (its release delayed) until the count drains, and the last one out
+ * tells it to release. joins per grant are capped, so a node cannot keep
+ * a resource from the other nodes' requests forever.
+ *
+ * words are updated with C11 atomics, so the cohort costs no messages.
+ **************************************************************************/
+#define CO_SLOTS    1024
+#define CO_PENDING  (1ULL << 62)
+#define CO_HELD     (2ULL << 62)
+#define CO_WORD(st, g, owner, joins, n) \
+    ((st) | ((uint64_t)((g) + 1) << 48) | ((uint64_t)(owner) << 32) | ((uint64_t)(joins) << 16) | (uint64_t)(n))
+#define CO_STATE(w) ((w) & (3ULL << 62))
+#define CO_GROUP(w) ((int)(((w) >> 48) & 0x3fff) - 1)
+#define CO_OWNER(w) ((int)(((w) >> 32) & 0xffff))
+#define CO_JOINS(w) ((int)(((w) >> 16) & 0xffff))
+#define CO_COUNT(w) ((int)((w) & 0xffff))
+
+typedef struct {
+    int on;
+    MPI_Comm node;          /* the ranks sharing this node's memory */
+    MPI_Win win;
+    _Atomic uint64_t *w;    /* CO_SLOTS words, in node rank 0's segment */
+    int me;                 /* rank in node */
+    int *world;             /* node rank -> world rank */
+} Cohort;
+
+/* collective over MPI_COMM_WORLD (a no-op unless on), like co_free */
+void co_init(Cohort *c, int on);
+void co_free(Cohort *c);
+/* join res's grant if it is held for a group of gs by fewer than max
+   joins so far; the group, or -1 (nothing held) */
+int  co_join(Cohort *c, int res, const uint64_t *gs, int max);
+/* become res's leader, counted in; 0 if another request leads it */
+int  co_lead(Cohort *c, int res);
+/* leader: the grant came, for group / never will */
+void co_held(Cohort *c, int res, int group);
+void co_abandon(Cohort *c, int res);
+/* a holder leaves: the world rank of the leader if it was the last one
+   in (the leader must co_end), else -1 */
+int  co_leave(Cohort *c, int res);
+/* leader: free the word if no one is in; 0 if someone joined again */
+int  co_end(Cohort *c, int res);
+
+/* collective over MPI_COMM_WORLD: the sub-manager of this rank's node
+   (sub.h), its lowest requester rank, and the node's requester ranks in
+   *nlocal. -1 on a node with no requester */
+int  node_sub(int requester, int *nlocal);
+
+#endif
@@ -0,0 +1,640 @@
+#include "req.h"
+#include "gset.h"
+#include "imap.h"
+#include "metrics.h"
+#include "trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* hedging: at most HEDGE_MAX alternate quorums per request; a manager
+   that stayed silent counts as this much extra load */
+#define HEDGE_MAX     2
+#define HEDGE_PENALTY 1000
+
+/* the protocol run of one client on one resource. exists while the
+   client has a request there, in flight or waiting its turn */
+typedef struct {
+    int c, rid, res;
+    int inuse;
+
+    RState state;
+    int my_ts;
+    uint64_t *gset;                 /* group set of the current request */
+    int cand[HEDGE_MAX + 1];        /* quorums asked, the first one and hedges */
+    int ncand;
+    int *to; int nto;               /* every manager asked */
+    unsigned char *ok_from;         /* OK held from to[i] ... */
+    int *ok_group;                  /* ... and the group it named, -1 none */
+    const int *quorum; int qn;      /* the pivot's session: the quorum it locked */
+    int ok_count, finished_count;
+    double hedge_at;                /* ask another quorum then, 0 = never */
+    int pivot;                      /* in the CS as pivot (else follower) */
+    int group, enter_ts;
+    int cur_seq;                    /* request the current protocol run serves */
+    int pend_seq;                   /* request waiting for R_IDLE, 0 = none */
+    uint64_t *pend_gs;
+    int gave_up;                    /* release cur_seq's grant at once if >= */
+    int revoked;                    /* a manager wants the session back */
+    double lease_end;               /* R_LEASE until then */
+    double since;                   /* metrics: in state since */
+} Sess;
+
+struct Req {
+    const Config *cfg;
+    const Coterie *cot;
+    ReqHooks hk;
+    int rank, gw, n;
+    int *lamport;
+
+    /* the current step */
+    double now;
+    Out *out;
+
+    Sess *ss; int nss;              /* session slots ... */
+    int *sfree; int nfree;          /* ... the unused ones ... */
+    IMap sidx;                      /* ... and (rid, res) -> slot */
+    int maxq;
+    int *dst;                       /* destination scratch, (HEDGE_MAX + 1) * maxq */
+    int *mload;                     /* last load reported by each manager */
+    uint64_t rng;
+    int nbusy;                      /* sessions not in R_IDLE */
+    int nlease;                     /* ... of which in R_LEASE */
+    int closing;
+    int *myq; int nmyq;             /* symmetric: quorums holding our own manager */
+};
+
+/**************************************************************************
+ * sessions
+ **************************************************************************/
+static inline uint64_t ss_key(int rid, int res) {
+    return (uint64_t)(uint32_t)rid << 32 | (uint32_t)res;
+}
+
+static Sess *ss_find(Req *rq, int rid, int res) {
+    int i = im_get(&rq->sidx, ss_key(rid, res));
+    return i < 0 ? NULL : &rq->ss[i];
+}
+
+static Sess *ss_get(Req *rq, int c, int res) {
+    int rid = rid_of(rq->rank, c, rq->n);
+    Sess *s = ss_find(rq, rid, res);
+    if (s) return s;
+
+    int i;
+    if (rq->nfree) i = rq->sfree[--rq->nfree];
+    else {
+        i = rq->nss++;
+        rq->ss = xrealloc(rq->ss, rq->nss * sizeof(Sess));
+        rq->sfree = xrealloc(rq->sfree, rq->nss * sizeof(int));
+        s = &rq->ss[i];
+        memset(s, 0, sizeof(*s));
+        s->gset = xrealloc(NULL, 2 * rq->gw * sizeof(uint64_t));
+        s->pend_gs = s->gset + rq->gw;
+        s->to = xrealloc(NULL, (HEDGE_MAX + 1) * rq->maxq * sizeof(int));
+        s->ok_from = xrealloc(NULL, (HEDGE_MAX + 1) * rq->maxq);
+        s->ok_group = xrealloc(NULL, (HEDGE_MAX + 1) * rq->maxq * sizeof(int));
+    }
+    s = &rq->ss[i];
+    s->c = c; s->rid = rid; s->res = res;
+    s->inuse = 1;
+    s->state = R_IDLE;
+    s->since = mt_now();
+    s->pend_seq = 0;
+    s->gave_up = -1;
+    im_put(&rq->sidx, ss_key(rid, res), i);
+    return s;
+}
+
+/* forget s once it has nothing left to do */
+static void ss_put(Req *rq, Sess *s) {
+    if (s->state != R_IDLE || s->pend_seq || !s->inuse) return;
+    mt_state(mt.rstate_ns, s->state, &s->since);
+    im_del(&rq->sidx, ss_key(s->rid, s->res));
+    s->inuse = 0;
+    rq->sfree[rq->nfree++] = (int)(s - rq->ss);
+}
+
+/**************************************************************************
+ * requester state machine
+ **************************************************************************/
+static void rq_try_issue(Req *rq, Sess *s);
+
+static inline void ss_state(Sess *s, RState st) {
+    mt_state(mt.rstate_ns, s->state, &s->since);
+    s->state = st;
+}
+
+/* sum of the loads last heard from quorum i's members */
+static int quorum_load(const Req *rq, int i) {
+    int qn, load = 0;
+    const int *q = cot_quorum(rq->cot, i, &qn);
+    for (int k = 0; k < qn; ++k) load += rq->mload[q[k]];
+    return load;
+}
+
+/* xorshift64* */
+static uint64_t rq_rand(Req *rq) {
+    uint64_t x = rq->rng;
+    x ^= x >> 12; x ^= x << 25; x ^= x >> 27;
+    rq->rng = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+/* send the request to quorum qi's members not asked yet */
+static void rq_ask(Req *rq, Sess *s, int qi) {
+    int gw = rq->gw, qn;
+    const int *q = cot_quorum(rq->cot, qi, &qn);
+    int first = s->nto;
+    for (int k = 0; k < qn; ++k) {
+        int i = 0;
+        while (i < s->nto && s->to[i] != q[k]) ++i;
+        if (i < s->nto) continue;
+        s->to[s->nto] = q[k];
+        s->ok_group[s->nto] = -1;
+        s->ok_from[s->nto++] = 0;
+        /* until they say otherwise, count our request in their load */
+        ++rq->mload[q[k]];
+    }
+    s->cand[s->ncand++] = qi;
+
+    Msg req = { s->my_ts, rq->rank, -1, gw, 0, s->rid, s->res, 0 };
+    ++*rq->lamport;
+    out_multicast(rq->out, &req, s->gset, gw, s->to + first, s->nto - first, TAG_REQUEST, *rq->lamport);
+    for (int i = first; i < s->nto; ++i)
+        TRACE(EV_REQ_REQUEST, *rq->lamport, s->rid, s->my_ts, s->to[i]);
+}
+
+/* hash to a quorum, spreading resources over them; symmetric ranks
+   stick to quorums holding their own manager, whose messages stay in
+   memory. with PICK_LOAD, the lighter of that one and a random one
+   (power of two choices); ties keep the hashed one */
+int req_quorum(Req *rq, int rid, int res, const uint64_t *gs) {
+    unsigned mask = gs_fold(gs, rq->gw) + (unsigned)rid + (unsigned)res;
+    unsigned nq = rq->nmyq ? (unsigned)rq->nmyq : (unsigned)rq->cot->nq;
+    int chosen = rq->nmyq ? rq->myq[mask % nq] : (int)(mask % nq);
+    if (rq->cfg->pick == PICK_LOAD && nq > 1) {
+        unsigned k = (unsigned)(rq_rand(rq) % nq);
+        int alt = rq->nmyq ? rq->myq[k] : (int)k;
+        int lc = quorum_load(rq, chosen), la = quorum_load(rq, alt);
+        if (la < lc) {
+            TRACE(EV_REQ_PICK, *rq->lamport, rid, alt, la, chosen, lc);
+            chosen = alt;
+        }
+    }
+    return chosen;
+}
+
+static void rq_issue(Req *rq, Sess *s) {
+    const Coterie *cot = rq->cot;
+    int gw = rq->gw, rid = s->rid;
+
+    s->my_ts = ++*rq->lamport;
+    s->ok_count = 0; s->finished_count = 0;
+    s->revoked = 0;
+    s->nto = 0; s->ncand = 0;
+
+    int chosen = req_quorum(rq, rid, s->res, s->gset);
+    int qn; cot_quorum(cot, chosen, &qn);
+    TRACE(EV_REQ_ISSUE, *rq->lamport, rid, s->res, s->my_ts, chosen, qn, TR_GS(s->gset, gw));
+    rq_ask(rq, s, chosen);
+    s->hedge_at = rq->cfg->hedge > 0 ? rq->now + rq->cfg->hedge : 0;
+    ss_state(s, R_WAIT);
+    ++rq->nbusy;
+}
+
+/* no grant in time: ask an alternate quorum too, with the same
+   timestamp. managers that stayed silent are charged HEDGE_PENALTY until
+   they report their load again, which steers this and later picks away
+   from them */
+static void rq_hedge(Req *rq, Sess *s) {
+    const Coterie *cot = rq->cot;
+    for (int i = 0; i < s->nto; ++i)
+        if (!s->ok_from[i]) rq->mload[s->to[i]] += HEDGE_PENALTY;
+
+    int best = -1, bl = 0;
+    for (int qi = 0; qi < cot->nq; ++qi) {
+        int k = 0;
+        while (k < s->ncand && s->cand[k] != qi) ++k;
+        if (k < s->ncand) continue;
+        int l = quorum_load(rq, qi);
+        if (best < 0 || l < bl) { best = qi; bl = l; }
+    }
+    s->hedge_at = 0;
+    if (best < 0) return;
+
+    int before = s->nto;
+    rq_ask(rq, s, best);
+    TRACE(EV_REQ_HEDGE, *rq->lamport, s->rid, s->res, s->my_ts, best, s->nto - before);
+    if (s->ncand < HEDGE_MAX + 1) s->hedge_at = rq->now + rq->cfg->hedge;
+}
+
+/* a quorum asked for this request whose members all sent OK, or -1 */
+static int rq_full_quorum(const Req *rq, const Sess *s) {
+    for (int c = 0; c < s->ncand; ++c) {
+        int qn, k = 0;
+        const int *q = cot_quorum(rq->cot, s->cand[c], &qn);
+        for (; k < qn; ++k) {
+            int i = 0;
+            while (i < s->nto && s->to[i] != q[k]) ++i;
+            if (i == s->nto || !s->ok_from[i]) break;
+        }
+        if (k == qn) return s->cand[c];
+    }
+    return -1;
+}
+
+/* the group a pivot locks (paper: arbitrary): the first of its set, or
+   with --admit=largest the one most of its quorum's OKs name, so the
+   session can admit the most requests */
+static int rq_lock_group(Req *rq, const Sess *s) {
+    int best = gs_first(s->gset, rq->gw), votes = 0;
+    if (best < 0) return 0;
+    if (rq->cfg->admit != ADMIT_LARGEST) return best;
+    int *named = rq->dst;
+    for (int k = 0; k < s->qn; ++k) {
+        int i = 0;
+        while (i < s->nto && s->to[i] != s->quorum[k]) ++i;
+        int g = i < s->nto ? s->ok_group[i] : -1;
+        named[k] = g >= 0 && g < rq->cfg->ngroups && gs_test(s->gset, g) ? g : -1;
+    }
+    for (int k = 0; k < s->qn; ++k) {
+        if (named[k] < 0) continue;
+        int v = 0;
+        for (int j = 0; j < s->qn; ++j) v += named[j] == named[k];
+        if (v > votes || (v == votes && named[k] < best)) { best = named[k]; votes = v; }
+    }
+    return best;
+}
+
+/* NONEED to the managers asked that are outside the quorum locked */
+static void rq_withdraw(Req *rq, Sess *s, int group) {
+    int n = 0;
+    for (int i = 0; i < s->nto; ++i) {
+        int k = 0;
+        while (k < s->qn && s->quorum[k] != s->to[i]) ++k;
+        if (k == s->qn) rq->dst[n++] = s->to[i];
+    }
+    if (!n) return;
+    Msg nd = { s->my_ts, rq->rank, group, 0, 0, s->rid, s->res, 0 };
+    ++*rq->lamport;
+    out_multicast(rq->out, &nd, NULL, 0, rq->dst, n, TAG_NONEED, *rq->lamport);
+    for (int i = 0; i < n; ++i)
+        TRACE(EV_REQ_NONEED, *rq->lamport, s->rid, nd.timestamp, rq->dst[i]);
+}
+
+/* pivot's two-phase release: RELEASE, then OVER once all FINISHED */
+static void rq_unlock(Req *rq, Sess *s) {
+    int rank = rq->rank, rid = s->rid;
+    Msg rel = { s->my_ts, rank, s->group, 0, 0, rid, s->res, 0 };
+    ++*rq->lamport;
+    out_multicast(rq->out, &rel, NULL, 0, s->quorum, s->qn, TAG_RELEASE, *rq->lamport);
+    for (int i = 0; i < s->qn; ++i)
+        TRACE(EV_REQ_RELEASE, *rq->lamport, rid, s->my_ts, s->quorum[i]);
+    ss_state(s, R_OUT);
+    s->finished_count = 0;
+}
+
+static void rq_lease_end(Req *rq, Sess *s) {
+    if (s->state != R_LEASE) return;
+    TRACE(EV_REQ_LEASE_END, *rq->lamport, s->rid, s->res, s->revoked);
+    --rq->nlease;
+    rq_unlock(rq, s);
+}
+
+static void rq_release(Req *rq, Sess *s) {
+    int rank = rq->rank, rid = s->rid;
+    if (s->state != R_IN) return;
+
+    if (s->pivot) {
+        TRACE(EV_REQ_CS_PIVOT_OUT, *rq->lamport, rid, s->res);
+
+        /* lease: keep the managers locked on our group for a while, so
+           the next acquire of it can re-enter without a round */
+        if (rq->cfg->lease > 0 && !s->revoked && !rq->closing) {
+            ss_state(s, R_LEASE);
+            s->lease_end = rq->now + rq->cfg->lease;
+            ++rq->nlease;
+            TRACE(EV_REQ_LEASE, *rq->lamport, rid, s->res, s->group);
+            rq_try_issue(rq, s);
+            return;
+        }
+        rq_unlock(rq, s);
+    } else {
+        TRACE(EV_REQ_CS_FOL_OUT, *rq->lamport, rid, s->res, s->group);
+
+        /* follower RELEASE: every manager that admitted us drops us
+           from its followers (the others ignore it) */
+        Msg rel = { s->enter_ts, rank, s->group, 0, 0, rid, s->res, 0 };
+        ++*rq->lamport;
+        out_multicast(rq->out, &rel, NULL, 0, s->to, s->nto, TAG_RELEASE, *rq->lamport);
+        for (int i = 0; i < s->nto; ++i)
+            TRACE(EV_REQ_FOL_RELEASE, *rq->lamport, rid, rel.timestamp, s->to[i]);
+        ss_state(s, R_IDLE);
+        --rq->nbusy;
+        rq_try_issue(rq, s);
+    }
+}
+
+/* CS granted: hand it to the caller, or give it straight back if the
+   caller stopped waiting */
+static void rq_enter(Req *rq, Sess *s) {
+    ss_state(s, R_IN);
+    if (s->pivot) TRACE(EV_REQ_CS_PIVOT_IN, *rq->lamport, s->rid, s->res);
+    else TRACE(EV_REQ_CS_FOL_IN, *rq->lamport, s->rid, s->res, s->group);
+
+    int abandoned = s->gave_up >= s->cur_seq ||
+                    !rq->hk.grant(rq->hk.ctx, s->c, s->res, s->cur_seq, s->group);
+    if (abandoned) {
+        TRACE(EV_REQ_ABANDON, *rq->lamport, s->rid, s->cur_seq, s->res);
+        rq_release(rq, s);
+    }
+}
+
+/* issue the waiting request once the previous one is over, or serve it
+   from the lease; s is gone afterwards if that leaves it idle */
+static void rq_try_issue(Req *rq, Sess *s) {
+    if (s->state == R_LEASE && s->pend_seq) {
+        if (!s->revoked && gs_test(s->pend_gs, s->group) && rq->now < s->lease_end) {
+            int seq = s->pend_seq;
+            s->pend_seq = 0;
+
+            if (rq->hk.gave_up(rq->hk.ctx, s->c, seq)) return;
+
+            --rq->nlease;
+            s->cur_seq = seq;
+            gs_copy(s->gset, s->pend_gs, rq->gw);
+            TRACE(EV_REQ_LEASE_HIT, *rq->lamport, s->rid, s->res);
+            rq_enter(rq, s);
+            return;
+        }
+        /* another group, or too late: the request waits for our OVER */
+        rq_lease_end(rq, s);
+    }
+    if (s->state == R_IDLE && s->pend_seq && !rq->closing) {
+        int seq = s->pend_seq;
+        s->pend_seq = 0;
+
+        if (!rq->hk.gave_up(rq->hk.ctx, s->c, seq)) {
+            s->cur_seq = seq;
+            gs_copy(s->gset, s->pend_gs, rq->gw);
+            rq_issue(rq, s);
+        }
+    }
+    ss_put(rq, s);
+}
+
+static void rq_request(Req *rq, int c, int res, int seq, const uint64_t *gs) {
+    Sess *s = ss_get(rq, c, res);
+    s->pend_seq = seq;
+    gs_copy(s->pend_gs, gs, rq->gw);
+    rq_try_issue(rq, s);
+}
+
+/* no new requests from here on. every request in flight is seen through
+   (a waiting one is released the moment it is granted: a manager may
+   already count it as a follower), so the managers are left clean */
+static void rq_close(Req *rq) {
+    rq->closing = 1;
+    for (int i = 0; i < rq->nss; ++i) {
+        Sess *s = &rq->ss[i];
+        if (!s->inuse) continue;
+        s->gave_up = s->cur_seq;
+        s->pend_seq = 0;
+        rq_release(rq, s);
+        rq_lease_end(rq, s);
+        ss_put(rq, s);
+    }
+}
+
+static void rq_on_msg(Req *rq, const Msg *msg, int tag, int src) {
+    int rank = rq->rank;
+
+    *rq->lamport = max2(*rq->lamport, msg->clock) + 1;
+    mt_count(mt.recv, tag, 1);
+    if (src >= 0 && src < rq->cfg->nmgr) rq->mload[src] = msg->load;
+    Sess *s = ss_find(rq, msg->rid, msg->res);
+    if (!s) {
+        TRACE(EV_REQ_STRAY, *rq->lamport, msg->rid, tag, src, -1);
+        ++mt.stray;
+        return;
+    }
+
+    int rid = s->rid, qn = s->qn;
+    TRACE(EV_REQ_RECV, *rq->lamport, rid, tag, src, s->res, msg->timestamp, s->state);
+
+    int ti = 0;
+    while (ti < s->nto && s->to[ti] != src) ++ti;
+
+    /* a request our session cannot take in is queued: stop re-entering
+       (at once if in the lease, else at the next release) */
+    if (tag == TAG_REVOKE) {
+        TRACE(EV_REQ_REVOKE, *rq->lamport, rid, s->res, src, s->state);
+        if (msg->timestamp != s->my_ts) return;
+        s->revoked = 1;
+        rq_lease_end(rq, s);
+        return;
+    }
+
+    if (s->state == R_WAIT) {
+        /* ignore old replies */
+        if (msg->timestamp != s->my_ts && (tag == TAG_OK || tag == TAG_ENTER || tag == TAG_CANCEL || tag == TAG_FINISHED)) {
+            TRACE(EV_REQ_STALE, *rq->lamport, rid, tag, src, msg->timestamp, s->my_ts);
+            ++mt.stale;
+            return;
+        }
+
+        if (tag == TAG_OK && ti < s->nto) {
+            if (!s->ok_from[ti]) { s->ok_from[ti] = 1; ++s->ok_count; }
+            s->ok_group[ti] = msg->group;
+            TRACE(EV_REQ_OK, *rq->lamport, rid, src, msg->timestamp, s->ok_count, s->nto);
+
+            int full = rq_full_quorum(rq, s);
+            if (full >= 0) {
+                /* lock the quorum that answered; the other managers asked
+                   drop the request (and hand back their OK) */
+                s->quorum = cot_quorum(rq->cot, full, &s->qn);
+                qn = s->qn;
+                int group = rq_lock_group(rq, s);
+                Msg lock = { s->my_ts, rank, group, 0, 0, rid, s->res, 0 };
+                ++*rq->lamport;
+                out_multicast(rq->out, &lock, NULL, 0, s->quorum, qn, TAG_LOCK, *rq->lamport);
+                for (int i = 0; i < qn; ++i)
+                    TRACE(EV_REQ_LOCK, *rq->lamport, rid, group, s->my_ts, s->quorum[i]);
+                TRACE(EV_REQ_PIVOT, *rq->lamport, rid, group, s->my_ts);
+                rq_withdraw(rq, s, group);
+
+                s->pivot = 1;
+                s->group = group;
+                rq_enter(rq, s);
+            }
+        }
+
+        else if (tag == TAG_ENTER) {
+            int enter_ts = msg->timestamp;
+            TRACE(EV_REQ_ENTER, *rq->lamport, rid, src, msg->group, enter_ts);
+
+            /* withdraw the request (and any OK held) at every manager asked */
+            Msg nd = { enter_ts, rank, msg->group, 0, 0, rid, s->res, 0 };
+            ++*rq->lamport;
+            out_multicast(rq->out, &nd, NULL, 0, s->to, s->nto, TAG_NONEED, *rq->lamport);
+            for (int i = 0; i < s->nto; ++i)
+                TRACE(EV_REQ_NONEED, *rq->lamport, rid, nd.timestamp, s->to[i]);
+
+            /* follower enters CS immediately */
+            s->pivot = 0;
+            s->group = msg->group;
+            s->enter_ts = enter_ts;
+            rq_enter(rq, s);
+        }
+
+        else if (tag == TAG_CANCEL) {
+            TRACE(EV_REQ_CANCEL, *rq->lamport, rid, src);
+
+            /* not locked yet: hand the OK back, the manager requeues
+               our request and we keep waiting */
+            if (ti < s->nto && s->ok_from[ti]) { s->ok_from[ti] = 0; --s->ok_count; }
+            Msg cancelled = { s->my_ts, rank, -1, 0, 0, rid, s->res, 0 };
+            ++*rq->lamport;
+            out_send(rq->out, &cancelled, src, TAG_CANCELLED, *rq->lamport);
+            TRACE(EV_REQ_CANCELLED, *rq->lamport, rid, src, s->ok_count, s->nto);
+        }
+    }
+
+    else if (s->state == R_OUT && tag == TAG_FINISHED && msg->timestamp == s->my_ts) {
+        ++s->finished_count;
+        TRACE(EV_REQ_FINISHED, *rq->lamport, rid, src, s->finished_count, qn);
+
+        if (s->finished_count == qn) {
+            Msg over = { s->my_ts, rank, -1, 0, 0, rid, s->res, 0 };
+            ++*rq->lamport;
+            out_multicast(rq->out, &over, NULL, 0, s->quorum, qn, TAG_OVER, *rq->lamport);
+            for (int i = 0; i < qn; ++i)
+                TRACE(EV_REQ_OVER, *rq->lamport, rid, s->my_ts, s->quorum[i]);
+            ss_state(s, R_IDLE);
+            --rq->nbusy;
+            rq_try_issue(rq, s);
+        }
+    }
+
+    /* late replies to a request already served (and CANCELs that crossed
+       our LOCK) need no answer */
+    else {
+        TRACE(EV_REQ_STRAY, *rq->lamport, rid, tag, src, s->state);
+        ++mt.stray;
+    }
+}
+
+/* when a session's timer fires (lease end or next hedge), -1 if none */
+static double rq_timer(const Sess *s) {
+    if (!s->inuse) return -1.0;
+    if (s->state == R_LEASE) return s->lease_end;
+    if (s->state == R_WAIT && s->hedge_at > 0) return s->hedge_at;
+    return -1.0;
+}
+
+/* earliest timer, -1 if none */
+static double rq_next_expiry(const Req *rq) {
+    double t = -1.0;
+    if (!rq->nlease && !(rq->cfg->hedge > 0)) return t;
+    for (int i = 0; i < rq->nss; ++i) {
+        double e = rq_timer(&rq->ss[i]);
+        if (e >= 0 && (t < 0 || e < t)) t = e;
+    }
+    return t;
+}
+
+static void rq_expire(Req *rq) {
+    if (!rq->nlease && !(rq->cfg->hedge > 0)) return;
+    double now = rq->now;
+    for (int i = 0; i < rq->nss; ++i) {
+        Sess *s = &rq->ss[i];
+        double e = rq_timer(s);
+        if (e < 0 || e > now) continue;
+        if (s->state == R_LEASE) rq_lease_end(rq, s);
+        else rq_hedge(rq, s);
+    }
+}
+
+
+/**************************************************************************
+ * steps
+ **************************************************************************/
+Req *req_open(const Config *cfg, const Coterie *cot, int rank, int nclients, int *lamport,
+              const ReqHooks *hk) {
+    Req *rq = xrealloc(NULL, sizeof(Req));
+    memset(rq, 0, sizeof(*rq));
+    rq->cfg = cfg; rq->cot = cot;
+    rq->hk = *hk;
+    rq->rank = rank;
+    rq->gw = GSET_WORDS(cfg->ngroups);
+    rq->n = nclients;
+    rq->lamport = lamport;
+
+    rq->maxq = cot_max_qsize(cot);
+    rq->dst = xrealloc(NULL, (HEDGE_MAX + 1) * rq->maxq * sizeof(int));
+    im_init(&rq->sidx);
+    rq->mload = xrealloc(NULL, cfg->nmgr * sizeof(int));
+    memset(rq->mload, 0, cfg->nmgr * sizeof(int));
+    rq->rng = (cfg->wl.seed ^ 0x9E3779B97F4A7C15ULL * (uint64_t)(rank + 1)) | 1;
+
+    if (cfg->symmetric) {
+        rq->myq = xrealloc(NULL, cot->nq * sizeof(int));
+        for (int i = 0; i < cot->nq; ++i) {
+            int qn; const int *q = cot_quorum(cot, i, &qn);
+            for (int k = 0; k < qn; ++k) if (q[k] == rank) { rq->myq[rq->nmyq++] = i; break; }
+        }
+    }
+
+    uint64_t *gs = xrealloc(NULL, rq->gw * sizeof(uint64_t));
+    for (int c = 0; c < nclients; ++c) {
+        int rid = rid_of(rank, c, nclients);
+        cfg_home_set(cfg, rid, gs);
+        TRACE(EV_REQ_START, *lamport, rid, TR_GS(gs, rq->gw));
+    }
+    free(gs);
+    return rq;
+}
+
+void req_close(Req *rq) {
+    for (int i = 0; i < rq->nss; ++i) { free(rq->ss[i].gset); free(rq->ss[i].to); free(rq->ss[i].ok_from); free(rq->ss[i].ok_group); }
+    free(rq->ss);
+    free(rq->sfree);
+    im_free(&rq->sidx);
+    free(rq->dst);
+    free(rq->mload);
+    free(rq->myq);
+    free(rq);
+}
+
+static inline void rq_step(Req *rq, double now, Out *out) { rq->now = now; rq->out = out; }
+
+void req_request(Req *rq, int c, int res, int seq, const uint64_t *gs, double now, Out *out) {
+    rq_step(rq, now, out);
+    if (c >= 0 && c < rq->n) rq_request(rq, c, res, seq, gs);
+}
+
+void req_release(Req *rq, int c, int res, double now, Out *out) {
+    rq_step(rq, now, out);
+    Sess *s = ss_find(rq, rid_of(rq->rank, c, rq->n), res);
+    if (s) rq_release(rq, s);
+}
+
+void req_on_msg(Req *rq, const Msg *msg, int tag, int src, double now, Out *out) {
+    rq_step(rq, now, out);
+    rq_on_msg(rq, msg, tag, src);
+}
+
+double req_next_timer(const Req *rq) { return rq_next_expiry(rq); }
+
+void req_expire(Req *rq, double now, Out *out) {
+    rq_step(rq, now, out);
+    rq_expire(rq);
+}
+
+void req_shutdown(Req *rq, double now, Out *out) {
+    rq_step(rq, now, out);
+    rq_close(rq);
+}
+
+int req_busy(const Req *rq) { return rq->nbusy; }
@@ -0,0 +1,59 @@
+#ifndef REQ_H
+#define REQ_H
+
+/**************************************************************************
+ * req - the requester state machine
+ *
+ * one Req per requester rank: the protocol runs (sessions) of its
+ * nclients logical requesters on every resource they ask for. a step
+ * takes one input - a request or release from the application, a
+ * protocol message, the timers - plus the current time, updates the
+ * sessions and appends what it sends to an Out. it never blocks, reads
+ * a clock or touches MPI: gme.c drives it from a rank's progress loop,
+ * the simulator from its event queue.
+ *
+ * grants go back to the driver through ReqHooks, called from inside a
+ * step (so a hook must not call back into the Req).
+ **************************************************************************/
+#include <stdint.h>
+
+#include "config.h"
+#include "coterie.h"
+#include "wire.h"
+
+typedef struct {
+    /* client c's request seq on res is granted, for group; 0 if the
+       caller gave up on it, which releases it at once */
+    int (*grant)(void *ctx, int c, int res, int seq, int group);
+    /* the caller gave up on client c's request seq, not issued yet */
+    int (*gave_up)(void *ctx, int c, int seq);
+    void *ctx;
+} ReqHooks;
+
+typedef struct Req Req;
+
+/* lamport is the rank's Lamport clock, shared with a co-located manager */
+Req *req_open(const Config *cfg, const Coterie *cot, int rank, int nclients, int *lamport,
+              const ReqHooks *hk);
+void req_close(Req *r);
+
+/* client c asks for res (request seq, > 0 and increasing per client) */
+void req_request(Req *r, int c, int res, int seq, const uint64_t *gs, double now, Out *out);
+void req_release(Req *r, int c, int res, double now, Out *out);
+/* the quorum requester rid's request for res with set gs goes to; the
+   RMA fast path (gme.c) takes the same one */
+int  req_quorum(Req *r, int rid, int res, const uint64_t *gs);
+/* a manager's message (any tag but TAG_APP_*) */
+void req_on_msg(Req *r, const Msg *msg, int tag, int src, double now, Out *out);
+
+/* earliest lease end or hedge, -1 if none; req_expire runs the due ones */
+double req_next_timer(const Req *r);
+void   req_expire(Req *r, double now, Out *out);
+
+/* no new requests from here on: every request in flight is seen through
+   (a waiting one is released the moment it is granted) */
+void req_shutdown(Req *r, double now, Out *out);
+/* sessions not idle; 0 after req_shutdown means the managers are clean */
+int  req_busy(const Req *r);
+
+#endif
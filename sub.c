@@ -0,0 +1,193 @@
+#include "sub.h"
+#include "gset.h"
+#include "imap.h"
+#include "metrics.h"
+#include "trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* one resource: the node's waiting requests and the grant it holds */
+enum { S_IDLE, S_ASKED, S_HELD };
+typedef struct {
+    int res, state;
+    int group;              /* S_HELD: the group granted */
+    int in;                 /* local holders */
+    int joins;              /* entered on the grant after it came */
+    Msg *q; int nq, qcap;   /* waiting, in arrival order */
+    uint64_t *qgs;          /* set of q[i] at qgs + i * gw */
+} SRes;
+
+struct Sub {
+    const Config *cfg;
+    int rank, gw, c;
+    int *lamport;
+    Req *rq;
+    int nlocal, ndone;      /* requester ranks on the node / closed */
+    int seq;                /* of the requests made for the node */
+    SRes **live; int nlive, lcap;
+    SRes **spare; int nspare;
+    IMap index;             /* res -> live slot */
+    uint64_t *want;         /* union of the waiting sets */
+};
+
+/**************************************************************************
+ * per-resource state, recycled like the manager's
+ **************************************************************************/
+static SRes *res_get(Sub *s, int id) {
+    int i = im_get(&s->index, (uint32_t)id);
+    if (i >= 0) return s->live[i];
+
+    SRes *r;
+    if (s->nspare) r = s->spare[--s->nspare];
+    else {
+        r = xrealloc(NULL, sizeof(SRes));
+        memset(r, 0, sizeof(*r));
+    }
+    r->res = id;
+    r->state = S_IDLE;
+    r->group = -1;
+    r->in = r->joins = r->nq = 0;
+
+    if (s->nlive == s->lcap) {
+        s->lcap = s->lcap ? 2 * s->lcap : 16;
+        s->live = xrealloc(s->live, s->lcap * sizeof(SRes *));
+        s->spare = xrealloc(s->spare, s->lcap * sizeof(SRes *));
+    }
+    im_put(&s->index, (uint32_t)id, s->nlive);
+    s->live[s->nlive++] = r;
+    return r;
+}
+
+/* recycle r if nothing is going on there any more */
+static void res_put(Sub *s, SRes *r) {
+    if (r->state != S_IDLE || r->nq || r->in) return;
+    int i = im_get(&s->index, (uint32_t)r->res);
+    im_del(&s->index, (uint32_t)r->res);
+    SRes *last = s->live[--s->nlive];
+    if (i < s->nlive) { s->live[i] = last; im_put(&s->index, (uint32_t)last->res, i); }
+    s->spare[s->nspare++] = r;
+}
+
+static void res_free(SRes *r) {
+    free(r->q);
+    free(r->qgs);
+    free(r);
+}
+
+static inline uint64_t *sr_gset(const Sub *s, const SRes *r, int i) { return r->qgs + (size_t)i * s->gw; }
+
+static void sr_queue(Sub *s, SRes *r, const Msg *m, const uint64_t *gs) {
+    if (r->nq == r->qcap) {
+        r->qcap = r->qcap ? 2 * r->qcap : 8;
+        r->q = xrealloc(r->q, r->qcap * sizeof(Msg));
+        r->qgs = xrealloc(r->qgs, (size_t)r->qcap * s->gw * sizeof(uint64_t));
+    }
+    r->q[r->nq] = *m;
+    gs_copy(sr_gset(s, r, r->nq), gs, s->gw);
+    ++r->nq;
+    TRACE(EV_SUB_QUEUE, *s->lamport, s->rank, m->rid, r->res, r->nq);
+}
+
+/**************************************************************************
+ * sub-manager
+ **************************************************************************/
+/* local request m enters on r's grant */
+static void sr_enter(Sub *s, SRes *r, const Msg *m, Out *out) {
+    Msg g = { m->timestamp, s->rank, r->group, 0, 0, m->rid, r->res, 0 };
+    ++*s->lamport;
+    out_send(out, &g, m->rank, TAG_SUB_GRANT, *s->lamport);
+    ++r->in;
+    ++mt.sub_grant;
+    TRACE(EV_SUB_ENTER, *s->lamport, s->rank, m->rid, r->res, r->group, r->in);
+}
+
+/* one request to the managers for every group the node waits for. a
+   lease may grant it at once, from inside req_request */
+static void sr_ask(Sub *s, SRes *r, double now, Out *out) {
+    gs_zero(s->want, s->gw);
+    for (int i = 0; i < r->nq; ++i) gs_or(s->want, sr_gset(s, r, i), s->gw);
+    r->state = S_ASKED;
+    TRACE(EV_SUB_ASK, *s->lamport, s->rank, r->res, r->nq, TR_GS(s->want, s->gw));
+    req_request(s->rq, s->c, r->res, ++s->seq, s->want, now, out);
+}
+
+void sub_granted(Sub *s, int res, int group, Out *out) {
+    int i = im_get(&s->index, (uint32_t)res);
+    if (i < 0) return;
+    SRes *r = s->live[i];
+    r->state = S_HELD;
+    r->group = group;
+    r->joins = 0;
+    TRACE(EV_SUB_GRANT, *s->lamport, s->rank, res, group, r->nq);
+
+    /* the group is in the set asked for, so someone waiting takes it */
+    int k = 0;
+    for (int j = 0; j < r->nq; ++j) {
+        if (gs_test(sr_gset(s, r, j), group)) { sr_enter(s, r, &r->q[j], out); continue; }
+        if (k != j) { r->q[k] = r->q[j]; gs_copy(sr_gset(s, r, k), sr_gset(s, r, j), s->gw); }
+        ++k;
+    }
+    r->nq = k;
+}
+
+void sub_on_msg(Sub *s, const Msg *msg, const uint64_t *gs, int tag, double now, Out *out) {
+    *s->lamport = max2(*s->lamport, msg->clock) + 1;
+    mt_count(mt.recv, tag, 1);
+    if (tag == TAG_SUB_DONE) { ++s->ndone; return; }
+
+    SRes *r = res_get(s, msg->res);
+    if (tag == TAG_SUB_REQUEST) {
+        /* join a grant of the group, at most K times per grant: holders
+           that keep overlapping would otherwise never give it back */
+        if (r->state == S_HELD && gs_test(gs, r->group) && r->joins < s->cfg->hier) {
+            ++r->joins;
+            sr_enter(s, r, msg, out);
+            return;
+        }
+        sr_queue(s, r, msg, gs);
+        if (r->state == S_IDLE) sr_ask(s, r, now, out);
+        return;
+    }
+
+    if (r->state != S_HELD || !r->in) {
+        TRACE(EV_SUB_STRAY, *s->lamport, s->rank, tag, msg->rank, r->res);
+        ++mt.stray;
+        res_put(s, r);
+        return;
+    }
+    if (--r->in) return;
+    TRACE(EV_SUB_RELEASE, *s->lamport, s->rank, r->res, r->nq);
+    r->state = S_IDLE;
+    req_release(s->rq, s->c, r->res, now, out);
+    if (r->nq) sr_ask(s, r, now, out);
+    else res_put(s, r);
+}
+
+int sub_done(const Sub *s) { return s->ndone == s->nlocal && !s->nlive; }
+
+Sub *sub_open(const Config *cfg, int rank, int nlocal, int *lamport, Req *rq, int c) {
+    Sub *s = xrealloc(NULL, sizeof(Sub));
+    memset(s, 0, sizeof(*s));
+    s->cfg = cfg;
+    s->rank = rank;
+    s->gw = GSET_WORDS(cfg->ngroups);
+    s->c = c;
+    s->lamport = lamport;
+    s->rq = rq;
+    s->nlocal = nlocal;
+    im_init(&s->index);
+    s->want = xrealloc(NULL, s->gw * sizeof(uint64_t));
+    TRACE(EV_SUB_START, *lamport, rank, nlocal);
+    return s;
+}
+
+void sub_close(Sub *s) {
+    for (int i = 0; i < s->nlive; ++i) res_free(s->live[i]);
+    for (int i = 0; i < s->nspare; ++i) res_free(s->spare[i]);
+    free(s->live);
+    free(s->spare);
+    im_free(&s->index);
+    free(s->want);
+    free(s);
+}
@@ -0,0 +1,46 @@
+#ifndef SUB_H
+#define SUB_H
+
+/**************************************************************************
+ * sub - the node-level sub-manager of hierarchical mode (--hier)
+ *
+ * the requesters of a node send their requests to one sub-manager on the
+ * node (TAG_SUB_REQUEST) instead of to the managers. per resource, it
+ * keeps the node's requests in arrival order and takes part in the
+ * global protocol as a single requester: one request whose group set is
+ * the union of the waiting ones. once that is granted a group, every
+ * waiting request that accepts it enters (TAG_SUB_GRANT); at most K
+ * later local requests for the group join the grant, so a node whose
+ * holders overlap still lets it go. the grant goes back to the
+ * managers when the last local holder is out (TAG_SUB_RELEASE), and the
+ * requests left over ask again. the managers see one request per node
+ * and resource instead of one per requester.
+ *
+ * a step only appends the messages it sends to an Out, like mgr and req.
+ * the global side runs on the rank's own Req, as the requests of one of
+ * its clients; the driver hands that client's grants to sub_granted.
+ **************************************************************************/
+#include "config.h"
+#include "req.h"
+#include "wire.h"
+
+typedef struct Sub Sub;
+
+/* nlocal requester ranks send here (this one included); client c of rq
+   carries the node's requests to the managers */
+Sub *sub_open(const Config *cfg, int rank, int nlocal, int *lamport, Req *rq, int c);
+void sub_close(Sub *s);
+/* a local requester's TAG_SUB_REQUEST, TAG_SUB_RELEASE or TAG_SUB_DONE */
+void sub_on_msg(Sub *s, const Msg *msg, const uint64_t *gs, int tag, double now, Out *out);
+/* rq granted the sub-manager's request on res, for group. called from
+   inside a Req step, so it does not call back into rq */
+void sub_granted(Sub *s, int res, int group, Out *out);
+/* every local requester has closed and nothing is held or waiting */
+int  sub_done(const Sub *s);
+
+/* tags the sub-manager handles */
+static inline int sub_tag(int tag) {
+    return tag == TAG_SUB_REQUEST || tag == TAG_SUB_RELEASE || tag == TAG_SUB_DONE;
+}
+
+#endif
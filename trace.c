@@ -0,0 +1,71 @@
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int tr_level = 0;
+
+static FILE *tr_file;
+static TraceEv *tr_buf;
+static int tr_n, tr_cap;
+static double (*tr_clock)(void);
+static int tr_owner;                    /* bumped by every tr_own */
+static _Thread_local int tr_mine = -1;  /* tr_owner when this thread took it */
+
+void tr_own(void) { tr_mine = ++tr_owner; }
+
+static void tr_flush(void) {
+    if (tr_n && fwrite(tr_buf, sizeof(TraceEv), tr_n, tr_file) != (size_t)tr_n)
+        fprintf(stderr, "trace: short write, events lost\n");
+    tr_n = 0;
+}
+
+int tr_open(const char *prefix, int rank, int level, int cap, double (*clock)(void)) {
+    tr_level = 0;
+    tr_clock = clock;
+    tr_own();
+    if (level <= 0) return 0;
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s.%d.bin", prefix, rank);
+    tr_cap = cap > 0 ? cap : 1;
+    tr_buf = malloc((size_t)tr_cap * sizeof(TraceEv));
+    tr_file = tr_buf ? fopen(path, "wb") : NULL;
+    if (!tr_file) { free(tr_buf); tr_buf = NULL; return -1; }
+
+    TraceHdr h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TR_MAGIC, sizeof(TR_MAGIC));
+    h.rank = rank;
+    h.evsize = sizeof(TraceEv);
+    fwrite(&h, sizeof(h), 1, tr_file);
+
+    tr_n = 0;
+    tr_level = level;
+    return 0;
+}
+
+void tr_emit(int id, int32_t lamport, const int32_t *a, int n) {
+    if (tr_mine != tr_owner) {
+        fprintf(stderr, "trace: event %d from a thread that does not own the buffer\n", id);
+        abort();
+    }
+    if (tr_n == tr_cap) tr_flush();
+    TraceEv *e = &tr_buf[tr_n++];
+    e->t = tr_clock();
+    e->lamport = lamport;
+    e->id = (uint16_t)id;
+    e->nargs = (uint16_t)(n < TR_NARGS ? n : TR_NARGS);
+    memcpy(e->a, a, e->nargs * sizeof(int32_t));
+    memset(e->a + e->nargs, 0, (TR_NARGS - e->nargs) * sizeof(int32_t));
+}
+
+void tr_close(void) {
+    if (!tr_file) return;
+    tr_flush();
+    fclose(tr_file);
+    free(tr_buf);
+    tr_file = NULL; tr_buf = NULL;
+    tr_level = 0;
+}
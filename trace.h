@@ -0,0 +1,169 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/**************************************************************************
+ * trace - per-rank binary event tracing
+ *
+ * every log line of the protocol is a typed event: an id from the table
+ * below plus up to TR_NARGS int arguments. events go into a preallocated
+ * per-rank linear buffer (not a ring: nothing is overwritten) that is
+ * written to PREFIX.RANK.bin and emptied when it fills up, and at exit;
+ * gme_trace merges the files by Lamport time and prints the human-readable
+ * log from the same table.
+ *
+ * levels: 0 off, 1 protocol messages and state changes, 2 adds queue
+ * snapshots and discarded messages.
+ *
+ * the buffer has a single writer and no locking: only the thread that
+ * owns it may emit. tr_open gives it to the calling thread and tr_own
+ * hands it to another one, which must happen after the old owner's last
+ * event (thread start or join). tr_emit aborts on any other thread.
+ *
+ * formats take only %d, plus %L for the event's Lamport clock and %G for
+ * a group set passed as four args: the index of its first non-empty word,
+ * the low and high half of that word, and the size of the whole set. the
+ * decoder lists the groups in that word and counts the rest
+ **************************************************************************/
+#include <stdint.h>
+
+#include "gset.h"
+
+/* colors */
+#define CLR_MGR   "\033[1;33m"
+#define CLR_REQ   "\033[1;36m"
+#define CLR_CS    "\033[1;32m"
+#define CLR_ERR   "\033[1;31m"
+#define CLR_ST    "\033[1;35m"
+#define CLR_RST   "\033[0m"
+
+#define TRACE_EVENTS(X) \
+    X(EV_MGR_START,        1, CLR_MGR, "[mgr %d] starting manager role (in %d/%d quorums)") \
+    X(EV_MGR_RECV,         1, CLR_MGR, "[mgr %d] recv tag=%d from %d res=%d (msg.ts=%d, gset=%G) state=%d lam=%L") \
+    X(EV_MGR_INSERT,       1, CLR_MGR, "[mgr %d] inserted request (r%d,ts=%d) -> queue size=%d") \
+    X(EV_MGR_QUEUE,        2, CLR_MGR, "[mgr %d] queue: size=%d head=(r%d,ts=%d)") \
+    X(EV_MGR_QUEUE_EMPTY,  2, CLR_MGR, "[mgr %d] queue: <empty>") \
+    X(EV_MGR_OK,           1, CLR_MGR, "[mgr %d] send OK -> r%d (ok.ts=%d) lam=%L") \
+    X(EV_MGR_CANCEL,       1, CLR_ERR, "[mgr %d] sent CANCEL -> r%d (old.ts=%d) lam=%L") \
+    X(EV_MGR_ENTER,        1, CLR_MGR, "[mgr %d] sent ENTER -> r%d group=%d (ent.ts=%d) lam=%L") \
+    X(EV_MGR_LOCK,         1, CLR_MGR, "[mgr %d] LOCK from r%d group=%d ts=%d state->LOCKED") \
+    X(EV_MGR_RELEASE,      1, CLR_MGR, "[mgr %d] RELEASE from r%d ts=%d state->RELEASING") \
+    X(EV_MGR_FOLLOWER_OUT, 1, CLR_MGR, "[mgr %d] follower r%d released -> remaining=%d") \
+    X(EV_MGR_STRAY_REL,    2, CLR_MGR, "[mgr %d] RELEASE from r%d not ours (ignored)") \
+    X(EV_MGR_FINISHED,     1, CLR_MGR, "[mgr %d] all followers done -> FINISHED to r%d (ts=%d) lam=%L") \
+    X(EV_MGR_NONEED,       1, CLR_MGR, "[mgr %d] NONEED from r%d (msg.ts=%d)") \
+    X(EV_MGR_WITHDRAW,     1, CLR_MGR, "[mgr %d] withdrew request of r%d -> queue size=%d") \
+    X(EV_MGR_NONEED_OK,    1, CLR_MGR, "[mgr %d] NONEED matched outstanding ok -> VACANT") \
+    X(EV_MGR_OK_NONEED,    1, CLR_MGR, "[mgr %d] send OK -> r%d (ok.ts=%d, after noneed) lam=%L") \
+    X(EV_MGR_CANCELLED,    1, CLR_MGR, "[mgr %d] CANCELLED ack from r%d") \
+    X(EV_MGR_OK_CANCELLED, 1, CLR_MGR, "[mgr %d] send OK -> r%d (ok.ts=%d, after cancelled) lam=%L") \
+    X(EV_MGR_STRAY_FIN,    2, CLR_MGR, "[mgr %d] unexpected FINISHED from %d (ignored)") \
+    X(EV_MGR_OVER,         1, CLR_MGR, "[mgr %d] OVER received -> VACANT") \
+    X(EV_MGR_OK_OVER,      1, CLR_MGR, "[mgr %d] send OK -> r%d (ok.ts=%d, after over) lam=%L") \
+    X(EV_MGR_REVOKE,       1, CLR_MGR, "[mgr %d] conflicting request queued -> REVOKE lease of r%d (ts=%d) lam=%L") \
+    X(EV_MGR_BYPASS,       2, CLR_MGR, "[mgr %d] admitted %d past a blocked request (%d this session)") \
+    X(EV_MGR_FENCE,        1, CLR_MGR, "[mgr %d] resource %d held by %d fast-path requesters -> no OK until they leave") \
+    X(EV_MGR_UNFENCE,      1, CLR_MGR, "[mgr %d] resource %d: fast-path holders gone") \
+    X(EV_MGR_OK_FENCE,     1, CLR_MGR, "[mgr %d] send OK -> r%d (ok.ts=%d, after fast path) lam=%L") \
+    X(EV_MGR_UNKNOWN,      1, CLR_ERR, "[mgr %d] unknown tag %d from %d") \
+    X(EV_MGR_RES_NEW,      2, CLR_MGR, "[mgr %d] resource %d active (%d live)") \
+    X(EV_MGR_RES_FREE,     2, CLR_MGR, "[mgr %d] resource %d idle, state freed (%d live)") \
+    X(EV_MGR_EXIT,         1, CLR_MGR, "[mgr %d] exiting manager") \
+    X(EV_SUB_START,        1, CLR_MGR, "[sub %d] starting sub-manager for %d requester ranks") \
+    X(EV_SUB_QUEUE,        2, CLR_MGR, "[sub %d] r%d waits for res %d (%d waiting)") \
+    X(EV_SUB_ASK,          1, CLR_MGR, "[sub %d] res %d: %d local requests -> asking the managers for gset=%G") \
+    X(EV_SUB_GRANT,        1, CLR_MGR, "[sub %d] res %d granted group %d (%d local requests waiting)") \
+    X(EV_SUB_ENTER,        1, CLR_MGR, "[sub %d] send GRANT -> r%d res=%d group=%d (%d in)") \
+    X(EV_SUB_RELEASE,      1, CLR_MGR, "[sub %d] res %d: local holders out -> releasing (%d still waiting)") \
+    X(EV_SUB_STRAY,        2, CLR_MGR, "[sub %d] ignoring tag=%d from %d for res %d") \
+    X(EV_REQ_START,        1, CLR_REQ, "[req %d] starting requester role gset=%G") \
+    X(EV_REQ_EXIT,         1, CLR_REQ, "[req %d] closing -> exiting") \
+    X(EV_REQ_ISSUE,        1, CLR_REQ, "[req %d] state idle->wait res=%d ts=%d chosen_quorum=%d size=%d gset=%G") \
+    X(EV_REQ_PICK,         2, CLR_REQ, "[req %d] quorum %d (load %d) over quorum %d (load %d)") \
+    X(EV_REQ_HEDGE,        1, CLR_REQ, "[req %d] res %d ts=%d not granted in time -> also asking quorum %d (+%d managers)") \
+    X(EV_REQ_REQUEST,      1, CLR_REQ, "[req %d] sent REQUEST(ts=%d) -> mgr %d lam=%L") \
+    X(EV_REQ_RECV,         1, CLR_REQ, "[req %d] recv tag=%d from %d res=%d (msg.ts=%d) state=%d lam=%L") \
+    X(EV_REQ_STALE,        2, CLR_REQ, "[req %d] ignoring old reply tag=%d from %d (msg.ts=%d != my_ts=%d)") \
+    X(EV_REQ_OK,           1, CLR_REQ, "[req %d] OK from mgr %d (ok.ts=%d) (%d/%d)") \
+    X(EV_REQ_LOCK,         1, CLR_REQ, "[req %d] sent LOCK(group=%d,ts=%d) -> mgr %d lam=%L") \
+    X(EV_REQ_PIVOT,        1, CLR_REQ, "[req %d] pivot entering CS group=%d ts=%d") \
+    X(EV_REQ_CS_PIVOT_IN,  1, CLR_CS,  "[req %d] in-crit-section (pivot) start res=%d") \
+    X(EV_REQ_CS_PIVOT_OUT, 1, CLR_CS,  "[req %d] in-crit-section (pivot) end res=%d") \
+    X(EV_REQ_RELEASE,      1, CLR_REQ, "[req %d] sent RELEASE(ts=%d) -> mgr %d lam=%L") \
+    X(EV_REQ_ENTER,        1, CLR_REQ, "[req %d] received ENTER from mgr %d grant group=%d (ent.ts=%d)") \
+    X(EV_REQ_NONEED,       1, CLR_REQ, "[req %d] sent NONEED(ts=%d) -> mgr %d lam=%L") \
+    X(EV_REQ_CS_FOL_IN,    1, CLR_CS,  "[req %d] in-crit-section (follower) start res=%d group=%d") \
+    X(EV_REQ_CS_FOL_OUT,   1, CLR_CS,  "[req %d] in-crit-section (follower) end res=%d group=%d") \
+    X(EV_REQ_FOL_RELEASE,  1, CLR_REQ, "[req %d] sent RELEASE (follower exit ts=%d) -> mgr %d lam=%L") \
+    X(EV_REQ_CANCEL,       1, CLR_ERR, "[req %d] received CANCEL from mgr %d -> giving its OK back") \
+    X(EV_REQ_CANCELLED,    1, CLR_REQ, "[req %d] sent CANCELLED -> mgr %d lam=%L (%d/%d)") \
+    X(EV_REQ_FINISHED,     1, CLR_REQ, "[req %d] received FINISHED from mgr %d (%d/%d)") \
+    X(EV_REQ_OVER,         1, CLR_REQ, "[req %d] sent OVER(ts=%d) -> mgr %d lam=%L") \
+    X(EV_REQ_STRAY,        2, CLR_REQ, "[req %d] ignoring tag=%d from %d in state %d") \
+    X(EV_REQ_ABANDON,      1, CLR_ERR, "[req %d] acquire #%d of res %d was given up -> releasing at once") \
+    X(EV_REQ_LEASE,        1, CLR_REQ, "[req %d] pivot keeps res %d locked for group %d (lease)") \
+    X(EV_REQ_FAST,         1, CLR_CS,  "[req %d] res %d taken on the fast path, group=%d quorum=%d, no messages") \
+    X(EV_REQ_FAST_MISS,    2, CLR_REQ, "[req %d] res %d contended at quorum %d -> message protocol") \
+    X(EV_REQ_FAST_OUT,     1, CLR_CS,  "[req %d] res %d released on the fast path, quorum=%d") \
+    X(EV_REQ_COHORT_LEAD,  1, CLR_REQ, "[req %d] res %d granted for group %d, open to the node's cohort") \
+    X(EV_REQ_COHORT_JOIN,  1, CLR_CS,  "[req %d] res %d joined on a node-mate's grant, group=%d, no messages") \
+    X(EV_REQ_COHORT_END,   1, CLR_REQ, "[req %d] res %d: the node's cohort is out -> releasing") \
+    X(EV_REQ_SUB_ENTER,    1, CLR_CS,  "[req %d] in-crit-section (sub-manager %d) start res=%d group=%d") \
+    X(EV_REQ_SUB_LEAVE,    1, CLR_CS,  "[req %d] in-crit-section (sub-manager %d) end res=%d") \
+    X(EV_REQ_LEASE_HIT,    1, CLR_CS,  "[req %d] re-entering res %d from the lease, no messages") \
+    X(EV_REQ_LEASE_END,    1, CLR_REQ, "[req %d] lease on res %d ends (revoked=%d) -> releasing") \
+    X(EV_REQ_REVOKE,       1, CLR_REQ, "[req %d] REVOKE for res %d from mgr %d in state %d")
+
+#define TR_ENUM(id, lvl, clr, fmt) id,
+#define TR_LVL(id, lvl, clr, fmt)  lvl,
+enum { TRACE_EVENTS(TR_ENUM) EV_COUNT };
+static const unsigned char TR_LEVEL[EV_COUNT] = { TRACE_EVENTS(TR_LVL) };
+
+#define TR_NARGS 10
+
+/* one event; files are a TraceHdr followed by events in emission order */
+typedef struct {
+    double   t;         /* the emitting rank's clock: MPI_Wtime(), or virtual time */
+    int32_t  lamport;
+    uint16_t id;
+    uint16_t nargs;
+    int32_t  a[TR_NARGS];
+} TraceEv;
+_Static_assert(sizeof(TraceEv) == 56, "TraceEv is part of the file format");
+
+#define TR_MAGIC "GMETRC1"
+typedef struct {
+    char    magic[8];
+    int32_t rank;
+    int32_t evsize;     /* sizeof(TraceEv) of the writer */
+} TraceHdr;
+
+extern int tr_level;
+
+/* events are stamped with clock(); 0 ok, -1 no file/memory */
+int  tr_open(const char *prefix, int rank, int level, int cap, double (*clock)(void));
+/* the calling thread becomes the only one allowed to emit */
+void tr_own(void);
+void tr_emit(int id, int32_t lamport, const int32_t *a, int n);
+void tr_close(void);
+
+/* TRACE(EV_x, lamport, args...): the first arg is always the rank */
+#define TRACE(id, lam, ...) do { \
+        if (tr_level >= TR_LEVEL[id]) { \
+            const int32_t a_[] = { __VA_ARGS__ }; \
+            tr_emit((id), (lam), a_, (int)(sizeof(a_) / sizeof(a_[0]))); \
+        } \
+    } while (0)
+
+/* index of the first non-empty word of s, 0 for the empty set */
+static inline int32_t tr_gs_word(const uint64_t *s, int w) {
+    int g = gs_first(s, w);
+    return g < 0 ? 0 : g >> 6;
+}
+
+/* %G arguments for a group set s of w words */
+#define TR_GS(s, w) tr_gs_word((s), (w)), \
+                    (int32_t)(uint32_t)(s)[tr_gs_word((s), (w))], \
+                    (int32_t)(uint32_t)((s)[tr_gs_word((s), (w))] >> 32), \
+                    (int32_t)gs_count((s), (w))
+
+#endif
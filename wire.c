@@ -0,0 +1,32 @@
+#include "wire.h"
+#include "metrics.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void out_init(Out *o) { memset(o, 0, sizeof(*o)); }
+void out_free(Out *o) { free(o->m); free(o->buf); memset(o, 0, sizeof(*o)); }
+
+void out_multicast(Out *o, const Msg *m, const uint64_t *gs, int nw, const int *dst, int n, int tag,
+                   int clock) {
+    if (n <= 0) return;
+    size_t len = sizeof(Msg) + (size_t)nw * sizeof(uint64_t);
+    if (o->used + len > o->bcap) {
+        o->bcap = 2 * (o->used + len) > 256 ? 2 * (o->used + len) : 256;
+        o->buf = xrealloc(o->buf, o->bcap);
+    }
+    if (o->n + n > o->cap) {
+        o->cap = 2 * (o->n + n) > 16 ? 2 * (o->n + n) : 16;
+        o->m = xrealloc(o->m, o->cap * sizeof(OutMsg));
+    }
+
+    /* header and payload are whole words, so offsets stay aligned */
+    unsigned char *p = o->buf + o->used;
+    memcpy(p, m, sizeof(Msg));
+    ((Msg *)p)->clock = clock;
+    if (nw) memcpy(p + sizeof(Msg), gs, (size_t)nw * sizeof(uint64_t));
+    for (int i = 0; i < n; ++i)
+        o->m[o->n++] = (OutMsg){ dst[i], tag, (int)o->used, (int)len };
+    o->used += len;
+    mt_count(mt.sent, tag, n);
+}
@@ -0,0 +1,95 @@
+#ifndef WIRE_H
+#define WIRE_H
+
+/**************************************************************************
+ * wire - the protocol's messages, free of any transport
+ *
+ *   Msg  the packed message header
+ *   Out  messages a state machine step sends, for its driver to deliver
+ *
+ * the manager and requester state machines only see this header, so the
+ * MPI program (proto.h) and the simulator drive the same code.
+ **************************************************************************/
+#include <stddef.h>
+#include <stdint.h>
+
+/* message tags; TAG_APP_* are a requester's own commands to its
+   progress thread and never leave the rank. TAG_COHORT goes between
+   requesters on one node (gme.c), TAG_SUB_* between a node's requesters
+   and its sub-manager (sub.h) */
+enum { TAG_REQUEST, TAG_OK, TAG_LOCK, TAG_ENTER,
+       TAG_RELEASE, TAG_NONEED, TAG_CANCEL,
+       TAG_CANCELLED, TAG_FINISHED, TAG_OVER, TAG_REVOKE, TAG_COHORT,
+       TAG_SUB_REQUEST, TAG_SUB_GRANT, TAG_SUB_RELEASE, TAG_SUB_DONE,
+       TAG_APP_ACQUIRE, TAG_APP_RELEASE, TAG_APP_CLOSE };
+
+/* wire header: packed, sent and received as raw bytes. a REQUEST is
+   followed by nwords words of the requester's group set; every other
+   message is the header alone. timestamp is the request's priority,
+   clock the sender's Lamport clock at the send. rid is the logical
+   requester the message is from (requester -> manager) or for (manager
+   -> requester); rank is always the sending rank. res names the lock
+   the message is about: every resource is an independent instance of
+   the protocol, multiplexed over the same managers and requesters.
+   load is set on manager -> requester messages to the manager's current
+   load (queued requests plus resources in a session), 0 elsewhere */
+typedef struct {
+    int32_t timestamp;
+    int32_t rank;
+    int32_t group;
+    int32_t nwords;
+    int32_t clock;
+    int32_t rid;
+    int32_t res;
+    int32_t load;
+} Msg;
+_Static_assert(sizeof(Msg) == 32, "Msg must stay a 32-byte packed header");
+
+/* manager/requester states */
+typedef enum { M_VACANT, M_WAITLOCK, M_LOCKED, M_RELEASING, M_WAITCANCEL } MState;
+typedef enum { R_IDLE, R_WAIT, R_IN, R_OUT, R_LEASE } RState;
+
+/* logical requester c of a rank hosting n of them; rids are unique
+   across the job and equal the rank when n == 1 */
+static inline int rid_of(int rank, int c, int n) { return rank * n + c; }
+
+/* helpers */
+static inline int max2(int a, int b) { return a > b ? a : b; }
+static inline int higher(int ts1, int r1, int ts2, int r2) {
+    if (ts1 < ts2) return 1;
+    if (ts1 > ts2) return 0;
+    return r1 < r2;
+}
+
+/* aborts on OOM; each program defines it (the MPI one aborts the job) */
+void *xrealloc(void *p, size_t sz);
+
+/**************************************************************************
+ * outbox - the messages of one step, in send order
+ *
+ * a multicast stores its bytes once and one entry per destination.
+ **************************************************************************/
+typedef struct {
+    int dst, tag;
+    int off, len;           /* bytes at buf + off */
+} OutMsg;
+
+typedef struct {
+    OutMsg *m; int n, cap;
+    unsigned char *buf; size_t used, bcap;
+} Out;
+
+void out_init(Out *o);
+void out_free(Out *o);
+static inline void out_clear(Out *o) { o->n = 0; o->used = 0; }
+static inline const void *out_bytes(const Out *o, int i) { return o->buf + o->m[i].off; }
+
+/* header m, followed by nw words of gs, to n ranks; the header's clock
+   is set to clock */
+void out_multicast(Out *o, const Msg *m, const uint64_t *gs, int nw, const int *dst, int n, int tag,
+                   int clock);
+static inline void out_send(Out *o, const Msg *m, int dst, int tag, int clock) {
+    out_multicast(o, m, NULL, 0, &dst, 1, tag, clock);
+}
+
+#endif